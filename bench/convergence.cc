@@ -0,0 +1,101 @@
+// Image error against a high-spp reference as the sample count grows, for each sampler. Prints
+// one row per sample count with the RMSE of the display values (gamma 2, clamped to [0, 1]).
+//
+// Usage: convergence [spheres|indoor] [WIDTH] [REFERENCE_SPP] [MAX_SPP] [THREADS]
+
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/color.hh"
+#include "src/hittable_list.hh"
+#include "src/image_metrics.hh"
+#include "src/sampler.hh"
+#include "src/scenes.hh"
+
+namespace {
+
+auto Rmse(const std::vector<Color>& image, const std::vector<Color>& reference) -> double {
+  double squared_error = 0;
+  for (size_t k = 0; k < image.size(); k++) {
+    for (int c = 0; c < 3; c++) {
+      const double d = DisplayValue(image[k][c]) - DisplayValue(reference[k][c]);
+      squared_error += d * d;
+    }
+  }
+  return std::sqrt(squared_error / (3.0 * static_cast<double>(image.size())));
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const bool indoor = args.size() > 1 && std::string_view(args[1]) == "indoor";
+  const int width = args.size() > 2 ? std::stoi(args[2]) : 64;
+  const int reference_spp = args.size() > 3 ? std::stoi(args[3]) : 1024;
+  const int max_spp = args.size() > 4 ? std::stoi(args[4]) : 64;
+  const int threads = args.size() > 5 ? std::stoi(args[5]) : 0;
+
+  HittableList lights;
+  const HittableList scene = indoor ? IndoorScene(lights) : RandomSpheresScene();
+  const HittableList world(std::make_shared<BVHNode>(scene));
+
+  auto render = [&](SamplerKind sampler, int spp, uint64_t seed) {
+    Camera cam;
+    cam.SetAspectRatio(16.0 / 9.0);
+    cam.SetImageWidth(width);
+    cam.SetSamplePerPixel(spp);
+    cam.SetVUp(Vec3{0, 1, 0});
+    if (indoor) {
+      cam.SetMaxDepth(20);
+      cam.SetVFov(60);
+      cam.SetLookFrom(Point3{0, 1.5, 3.8});
+      cam.SetLookAt(Point3{0, 1.2, 0});
+      cam.SetBackground(Color(0, 0, 0));
+      cam.SetLights(&lights);
+    } else {
+      cam.SetMaxDepth(50);
+      cam.SetVFov(20);
+      cam.SetLookFrom(Point3{13, 2, 3});
+      cam.SetLookAt(Point3{0, 0, 0});
+      cam.SetDefocusAngle(0.6);
+      cam.SetFocusDist(10.0);
+    }
+    cam.SetThreadCount(threads);
+    cam.SetSampler(sampler);
+    cam.SetSeed(seed);
+    cam.Accumulate(world);
+    return cam.Accumulation().Image();
+  };
+
+  // A seed no measured render uses keeps the reference's noise independent of theirs.
+  const std::vector<Color> reference = render(SamplerKind::kSobol, reference_spp, 1000);
+
+  const std::vector<std::pair<const char*, SamplerKind>> samplers{
+      {"random", SamplerKind::kRandom},
+      {"stratified", SamplerKind::kStratified},
+      {"sobol", SamplerKind::kSobol},
+      {"bluenoise", SamplerKind::kBlueNoise}};
+  std::cout << std::setw(6) << "spp";
+  for (const auto& [name, kind] : samplers) {
+    std::cout << std::setw(12) << name;
+  }
+  std::cout << '\n';
+  for (int spp = 1; spp <= max_spp; spp *= 2) {
+    std::cout << std::setw(6) << spp;
+    for (const auto& [name, kind] : samplers) {
+      std::cout << std::setw(12) << std::fixed << std::setprecision(5)
+                << Rmse(render(kind, spp, 1), reference) << std::flush;
+    }
+    std::cout << '\n';
+  }
+}
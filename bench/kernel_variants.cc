@@ -0,0 +1,137 @@
+// Render time of the ray generation and sphere kernels specialized for the features a render
+// uses, against the generic ones that handle every feature, for each combination of a pinhole or
+// thin-lens camera and a scene at rest or in motion. The generic baseline renders with kernel
+// specialization off and builds the spheres at rest as moving spheres with no motion. Both
+// produce the same image, which the last column checks. Times are process CPU time, which time
+// spent descheduled (by other load, or another VM on the host) does not inflate.
+//
+// Usage: kernel_variants [WIDTH] [SPP] [THREADS]
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/color.hh"
+#include "src/common.hh"
+#include "src/hittable_list.hh"
+#include "src/material.hh"
+#include "src/sphere.hh"
+#include "src/vec3.hh"
+
+namespace {
+
+// The sphere field of the final scene, with its diffuse spheres moving or at rest. Spheres at rest
+// are built as `StaticSphere`.
+template <typename StaticSphere>
+auto SphereField(bool moving) -> HittableList {
+  auto at_rest = [](const Point3& center, double radius, std::shared_ptr<Material> material) {
+    if constexpr (std::is_same_v<StaticSphere, MovingSphere>) {
+      return std::make_shared<MovingSphere>(center, center, radius, std::move(material));
+    } else {
+      return std::make_shared<Sphere>(center, radius, std::move(material));
+    }
+  };
+
+  SeedRandom(0);
+  HittableList world;
+  world.Add(
+      at_rest(Point3(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+  for (int a = -11; a < 11; a++) {
+    for (int b = -11; b < 11; b++) {
+      const double choose_mat = RandomDouble();
+      const Point3 center(a + (0.9 * RandomDouble()), 0.2, b + (0.9 * RandomDouble()));
+      if (choose_mat < 0.8) {
+        const auto material = std::make_shared<Lambertian>(Color::Random() * Color::Random());
+        const Point3 center2 = center + Vec3(0, RandomDouble(0, .5), 0);
+        if (moving) {
+          world.Add(std::make_shared<MovingSphere>(center, center2, 0.2, material));
+        } else {
+          world.Add(at_rest(center, 0.2, material));
+        }
+      } else if (choose_mat < 0.95) {
+        world.Add(at_rest(center, 0.2,
+                          std::make_shared<Metal>(Color::Random(0.5, 1), RandomDouble(0, 0.5))));
+      } else {
+        world.Add(at_rest(center, 0.2, std::make_shared<Dielectric>(1.5)));
+      }
+    }
+  }
+  world.Add(at_rest(Point3(0, 1, 0), 1.0, std::make_shared<Dielectric>(1.5)));
+  world.Add(at_rest(Point3(-4, 1, 0), 1.0, std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+  world.Add(at_rest(Point3(4, 1, 0), 1.0, std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0)));
+  return world;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const int width = args.size() > 1 ? std::stoi(args[1]) : 300;
+  const int spp = args.size() > 2 ? std::stoi(args[2]) : 16;
+  const int threads = args.size() > 3 ? std::stoi(args[3]) : 0;
+  constexpr int kRuns = 5;  // Each time is the best of this many renders
+
+  std::cout << std::setw(10) << "camera" << std::setw(8) << "scene" << std::setw(12)
+            << "generic s" << std::setw(16) << "specialized s" << std::setw(10) << "speedup"
+            << std::setw(11) << "identical" << '\n';
+  for (const bool thin_lens : {false, true}) {
+    for (const bool moving : {false, true}) {
+      const HittableList generic_world(
+          std::make_shared<BVHNode>(SphereField<MovingSphere>(moving)));
+      const HittableList world(std::make_shared<BVHNode>(SphereField<Sphere>(moving)));
+
+      auto render = [&](const HittableList& scene, bool specialize, double& best_seconds) {
+        Camera cam;
+        cam.SetAspectRatio(16.0 / 9.0);
+        cam.SetImageWidth(width);
+        cam.SetSamplePerPixel(spp);
+        cam.SetMaxDepth(50);
+        cam.SetVFov(20);
+        cam.SetLookFrom(Point3{13, 2, 3});
+        cam.SetLookAt(Point3{0, 0, 0});
+        cam.SetDefocusAngle(thin_lens ? 0.6 : 0);
+        cam.SetFocusDist(10.0);
+        cam.SetThreadCount(threads);
+        cam.SetLogProgress(false);
+        cam.SetKernelSpecialization(specialize);
+
+        const std::clock_t start = std::clock();
+        cam.Accumulate(scene);
+        const double seconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+        best_seconds = std::min(best_seconds, seconds);
+        return cam.Accumulation().Image();
+      };
+
+      // Alternate the two, so that both see the same drift in clock speed.
+      double generic_seconds = kInfinity;
+      double specialized_seconds = kInfinity;
+      std::vector<Color> generic;
+      std::vector<Color> specialized;
+      for (int run = 0; run < kRuns; run++) {
+        generic = render(generic_world, false, generic_seconds);
+        specialized = render(world, true, specialized_seconds);
+      }
+      const bool identical =
+          std::equal(generic.begin(), generic.end(), specialized.begin(), specialized.end(),
+                     [](const Color& a, const Color& b) {
+                       return a.X() == b.X() && a.Y() == b.Y() && a.Z() == b.Z();
+                     });
+
+      std::cout << std::setw(10) << (thin_lens ? "thin lens" : "pinhole") << std::setw(8)
+                << (moving ? "moving" : "static") << std::fixed << std::setprecision(3)
+                << std::setw(12) << generic_seconds << std::setw(16) << specialized_seconds
+                << std::setprecision(2) << std::setw(9) << generic_seconds / specialized_seconds
+                << 'x' << std::setw(11) << (identical ? "yes" : "no") << std::defaultfloat << '\n'
+                << std::flush;
+    }
+  }
+}
@@ -0,0 +1,108 @@
+// Renders views of the generated scene from angles around it two ways: one at a time, building
+// the scene and its BVH for each as a separate process would, and as one batch that builds them
+// once and hands the tiles of every view to one render pool. Prints the time of each, the build
+// time plus the summed render times of the separate views that the batch should come close to,
+// and whether every batch image matches the separate one.
+//
+// Usage: multi_view [VIEWS] [SPHERES] [WIDTH] [SPP] [THREADS]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/color.hh"
+#include "src/common.hh"
+#include "src/hittable_list.hh"
+#include "src/render_pool.hh"
+#include "src/scene_generator.hh"
+#include "src/vec3.hh"
+
+namespace {
+
+auto SecondsSince(std::chrono::steady_clock::time_point start) -> double {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const int view_count = args.size() > 1 ? std::stoi(args[1]) : 12;
+  const auto spheres = static_cast<size_t>(args.size() > 2 ? std::stoull(args[2]) : 200000);
+  const int width = args.size() > 3 ? std::stoi(args[3]) : 160;
+  const int spp = args.size() > 4 ? std::stoi(args[4]) : 4;
+  const int threads = args.size() > 5 ? std::stoi(args[5]) : 0;
+
+  SceneParameters parameters;
+  parameters.sphere_count = spheres;
+  parameters.thread_count = threads;
+  auto build = [&] {
+    return HittableList(std::make_shared<BVHNode>(GeneratedScene(parameters), threads));
+  };
+
+  // Evenly around the field, looking across it from above its edge.
+  const double side = GeneratedFieldSide(spheres);
+  std::vector<Camera> views(static_cast<size_t>(view_count));
+  for (int k = 0; k < view_count; k++) {
+    const double angle = 2 * kPi * k / view_count;
+    Camera& cam = views[static_cast<size_t>(k)];
+    cam.SetAspectRatio(16.0 / 9.0);
+    cam.SetImageWidth(width);
+    cam.SetSamplePerPixel(spp);
+    cam.SetMaxDepth(50);
+    cam.SetVFov(40);
+    cam.SetLookFrom(Point3{0.85 * side * std::cos(angle), 2 + (0.15 * side),
+                           0.85 * side * std::sin(angle)});
+    cam.SetLookAt(Point3{0, 0, 0});
+    cam.SetThreadCount(threads);
+    cam.SetLogProgress(false);
+  }
+
+  std::vector<Camera> separate = views;
+  double build_seconds = 0;
+  double render_seconds = 0;
+  const auto separate_start = std::chrono::steady_clock::now();
+  for (Camera& cam : separate) {
+    auto start = std::chrono::steady_clock::now();
+    const HittableList world = build();
+    build_seconds += SecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    cam.Accumulate(world);
+    render_seconds += SecondsSince(start);
+  }
+  const double separate_seconds = SecondsSince(separate_start);
+
+  const auto batch_start = std::chrono::steady_clock::now();
+  const HittableList world = build();
+  const double batch_build_seconds = SecondsSince(batch_start);
+  Camera::AccumulateViews(world, views, threads, NumaMode::kOff);
+  const double batch_seconds = SecondsSince(batch_start);
+
+  bool identical = true;
+  for (size_t k = 0; k < views.size(); k++) {
+    const std::vector<Color> a = views[k].Accumulation().Image();
+    const std::vector<Color> b = separate[k].Accumulation().Image();
+    identical = identical && std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                                        [](const Color& x, const Color& y) {
+                                          return x.X() == y.X() && x.Y() == y.Y() && x.Z() == y.Z();
+                                        });
+  }
+
+  std::cout << view_count << " views of " << spheres << " spheres at " << width << " px, " << spp
+            << " spp\n"
+            << std::fixed << std::setprecision(3) << "separate:            " << separate_seconds
+            << " s (" << build_seconds << " s building, " << render_seconds << " s rendering)\n"
+            << "batch:               " << batch_seconds << " s (" << batch_build_seconds
+            << " s building)\n"
+            << "one build + renders: " << batch_build_seconds + render_seconds << " s\n"
+            << "identical:           " << (identical ? "yes" : "no") << '\n';
+}
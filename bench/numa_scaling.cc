@@ -0,0 +1,102 @@
+// Traces incoherent rays through the generated scene with a render pool in each NUMA mode (off,
+// pinned, and pinned with a scene replica per node), with 1, 2, 4, ... threads per node up to the
+// cores of the largest node. Prints the total ray rate of each, followed by the pool's per-node
+// tiles and throughput, to compare how each socket scales. On a single-node machine the modes
+// differ only in pinning.
+//
+// Usage: numa_scaling [SPHERES] [RAYS]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/common.hh"
+#include "src/hittable.hh"
+#include "src/hittable_list.hh"
+#include "src/interval.hh"
+#include "src/numa.hh"
+#include "src/ray.hh"
+#include "src/render_pool.hh"
+#include "src/scene_generator.hh"
+#include "src/vec3.hh"
+
+namespace {
+
+constexpr uint64_t kChunk = 4096;  // Rays per tile of the pool
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const auto spheres = static_cast<size_t>(args.size() > 1 ? std::stoull(args[1]) : 1000000);
+  const auto ray_count = static_cast<uint64_t>(args.size() > 2 ? std::stoull(args[2]) : 2000000);
+
+  const std::vector<NumaNode> nodes = DetectNumaTopology();
+  size_t max_per_node = 0;
+  for (const auto& node : nodes) {
+    max_per_node = std::max(max_per_node, node.cpus.size());
+  }
+  std::cout << nodes.size() << " NUMA nodes, up to " << max_per_node << " cores per node\n";
+
+  SceneParameters parameters;
+  parameters.sphere_count = spheres;
+  const HittableList world(std::make_shared<BVHNode>(GeneratedScene(parameters)));
+  const double side = GeneratedFieldSide(spheres);
+
+  // Random rays from just above the field, so that every ray visits its own part of the BVH.
+  auto make_ray = [&](uint64_t k) {
+    ObjectRandom random(1, 0, k);
+    const Point3 origin(side * (random.Next() - 0.5), random.Next(0, 2),
+                        side * (random.Next() - 0.5));
+    const double z = random.Next(-1, 1);
+    const double r = std::sqrt(1 - (z * z));
+    const double phi = 2 * kPi * random.Next();
+    return Ray(origin, Vec3(r * std::cos(phi), r * std::sin(phi), z), random.Next());
+  };
+
+  std::cout << std::setw(10) << "mode" << std::setw(18) << "threads per node" << std::setw(9)
+            << "threads" << std::setw(10) << "Mray/s" << '\n';
+  const std::pair<const char*, NumaMode> modes[] = {
+      {"off", NumaMode::kOff}, {"pin", NumaMode::kPin}, {"replicate", NumaMode::kReplicate}};
+  for (const auto& [name, mode] : modes) {
+    for (size_t per_node = 1;; per_node = std::min(2 * per_node, max_per_node)) {
+      const auto threads = static_cast<int>(per_node * nodes.size());
+      RenderPool pool(world, threads, mode);
+      std::atomic<uint64_t> hits{0};
+      const auto start = std::chrono::steady_clock::now();
+      pool.Run((ray_count + kChunk - 1) / kChunk, [&](size_t chunk, const Hittable& replica) {
+        uint64_t chunk_hits = 0;
+        for (uint64_t k = chunk * kChunk; k < std::min(ray_count, (chunk + 1) * kChunk); k++) {
+          HitRecord rec;
+          chunk_hits += replica.Hit(make_ray(k), Interval(0.001, kInfinity), rec) ? 1 : 0;
+        }
+        hits += chunk_hits;
+      });
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      if (hits == 0) {
+        std::cerr << "No ray hit the scene\n";
+      }
+
+      std::cout << std::setw(10) << name << std::setw(18) << per_node << std::setw(9)
+                << pool.ThreadCount() << std::fixed << std::setprecision(2) << std::setw(10)
+                << static_cast<double>(ray_count) / elapsed.count() * 1e-6 << std::defaultfloat
+                << '\n';
+      pool.ReportScaling(std::cout);
+      std::cout << std::flush;
+      if (per_node == max_per_node) {
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,133 @@
+// Renders the generated scene from a paged scene file under memory budgets from the size of the
+// whole file down to a quarter of it, tracing each ray on its own and with treelet queues, and
+// compares every image with a render of the in-memory BVH. Prints the render time, the pages read
+// in, the major page faults and the data read from disk of each. The file is written in a small
+// memory budget, so that the images also check the out-of-core writer against the BVH.
+//
+// Usage: out_of_core [SPHERES] [WIDTH] [SPP] [THREADS]
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/color.hh"
+#include "src/hittable.hh"
+#include "src/hittable_list.hh"
+#include "src/paged_scene.hh"
+#include "src/ray_sort.hh"
+#include "src/scene_generator.hh"
+#include "src/vec3.hh"
+
+namespace {
+
+// Small enough that the file of a million spheres is written out of core, in four bins.
+constexpr size_t kWriteBudget = size_t{64} * 1024 * 1024;
+
+struct RenderResult {
+  std::vector<Color> image;
+  double seconds;
+};
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const auto spheres = static_cast<size_t>(args.size() > 1 ? std::stoull(args[1]) : 1000000);
+  const int width = args.size() > 2 ? std::stoi(args[2]) : 200;
+  const int spp = args.size() > 3 ? std::stoi(args[3]) : 4;
+  const int threads = args.size() > 4 ? std::stoi(args[4]) : 0;
+
+  SceneParameters parameters;
+  parameters.sphere_count = spheres;
+  parameters.thread_count = threads;
+
+  auto render = [&](const Hittable& world) {
+    Camera cam;
+    const double side = GeneratedFieldSide(spheres);
+    cam.SetAspectRatio(16.0 / 9.0);
+    cam.SetImageWidth(width);
+    cam.SetSamplePerPixel(spp);
+    cam.SetMaxDepth(50);
+    cam.SetVFov(40);
+    cam.SetLookFrom(Point3{0.6 * side, 2 + (0.15 * side), 0.6 * side});
+    cam.SetLookAt(Point3{0, 0, 0});
+    cam.SetThreadCount(threads);
+    cam.SetRayOrder(RayOrder::kWavefront);
+    cam.SetLogProgress(false);
+    const auto start = std::chrono::steady_clock::now();
+    cam.Accumulate(world);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return RenderResult{.image = cam.Accumulation().Image(), .seconds = elapsed.count()};
+  };
+
+  RenderResult reference;
+  {
+    const HittableList world(std::make_shared<BVHNode>(GeneratedScene(parameters)));
+    reference = render(world);
+  }
+
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "out_of_core_bench.rtps").string();
+  const SphereSource source = [&](uint64_t first, std::span<SphereRecord> out) {
+    GeneratedSphereRecords(parameters, first, out);
+  };
+  if (!WritePagedScene(path, spheres + 1, source, GeneratedPalette::kGround + 1,
+                       GeneratedSceneKey(parameters), kWriteBudget)) {
+    return 1;
+  }
+  const uint64_t file_bytes = std::filesystem::file_size(path);
+  constexpr double kMiB = 1024.0 * 1024.0;
+  std::cout << spheres << " spheres, " << std::fixed << std::setprecision(1)
+            << static_cast<double>(file_bytes) / kMiB << " MiB paged scene; in-memory BVH "
+            << std::setprecision(3) << reference.seconds << " s\n";
+
+  std::cout << std::setw(11) << "budget MiB" << std::setw(8) << "queues" << std::setw(10)
+            << "render s" << std::setw(11) << "page-ins" << std::setw(10) << "read MiB"
+            << std::setw(14) << "major faults" << std::setw(11) << "identical" << '\n';
+  for (const double fraction : {1.0, 0.5, 0.25}) {
+    for (const bool queues : {false, true}) {
+      const auto budget =
+          static_cast<size_t>(std::ceil(static_cast<double>(file_bytes) * fraction));
+      const auto scene = std::make_shared<PagedScene>(GeneratedMaterials(parameters), budget);
+      if (!scene->Open(path)) {
+        return 1;
+      }
+      scene->SetTreeletQueues(queues);
+      const HittableList world(scene);
+
+      rusage before{};
+      getrusage(RUSAGE_SELF, &before);
+      const RenderResult result = render(world);
+      rusage after{};
+      getrusage(RUSAGE_SELF, &after);
+      const bool identical = std::equal(
+          result.image.begin(), result.image.end(), reference.image.begin(),
+          reference.image.end(), [](const Color& a, const Color& b) {
+            return a.X() == b.X() && a.Y() == b.Y() && a.Z() == b.Z();
+          });
+
+      std::cout << std::setprecision(1) << std::setw(11) << static_cast<double>(budget) / kMiB
+                << std::setw(8) << (queues ? "yes" : "no") << std::setprecision(3)
+                << std::setw(10) << result.seconds << std::setw(11)
+                << scene->PagingStats().page_ins << std::setprecision(1) << std::setw(10)
+                << static_cast<double>(512 * (after.ru_inblock - before.ru_inblock)) / kMiB
+                << std::setw(14) << after.ru_majflt - before.ru_majflt << std::setw(11)
+                << (identical ? "yes" : "no") << '\n'
+                << std::flush;
+    }
+  }
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,55 @@
+// Compares tracing the final scene per pixel, as an unsorted wavefront, and as a wavefront with
+// secondary rays sorted by origin and direction. Per-bounce ray rates are printed by the camera;
+// cache misses and the other hardware counters of each order are written to stdout as JSON.
+//
+// Usage: ray_sorting [THREADS]
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/hittable_list.hh"
+#include "src/perf_counters.hh"
+#include "src/ray_sort.hh"
+#include "src/scenes.hh"
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const int threads = args.size() > 1 ? std::stoi(args[1]) : 1;
+
+  const PerfCounters counters(PerfCounters::Scope::kProcess);
+  PerfProfile profile;
+  const HittableList world(std::make_shared<BVHNode>(RandomSpheresScene()));
+
+  for (const auto& [name, order] : {std::pair{"pixel", RayOrder::kPixel},
+                                    std::pair{"wavefront", RayOrder::kWavefront},
+                                    std::pair{"sorted", RayOrder::kSorted}}) {
+    Camera cam;
+    cam.SetAspectRatio(16.0 / 9.0);
+    cam.SetImageWidth(200);
+    cam.SetSamplePerPixel(16);
+    cam.SetMaxDepth(50);
+    cam.SetVFov(20);
+    cam.SetLookFrom(Point3{13, 2, 3});
+    cam.SetLookAt(Point3{0, 0, 0});
+    cam.SetDefocusAngle(0.6);
+    cam.SetFocusDist(10.0);
+    cam.SetThreadCount(threads);
+    cam.SetRayOrder(order);
+
+    std::clog << "== " << name << " ==\n";
+    const auto start = std::chrono::steady_clock::now();
+    {
+      const ScopedPerfRegion region(&profile, name, &counters);
+      cam.Accumulate(world);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::clog << name << ": " << elapsed.count() << " s\n";
+  }
+  profile.WriteJson(std::cout, counters.Error());
+}
@@ -0,0 +1,144 @@
+// Generates ever larger random sphere scenes and prints, for each size, the generation and BVH
+// build times, the peak resident memory, and the closest-hit ray rates for coherent camera rays
+// and for incoherent rays with random origins and directions. Sizes grow by about sqrt(10) from
+// a thousand spheres up to MAX_SPHERES; since they only grow, the peak memory of each row is
+// that of its own scene.
+//
+// Usage: scene_scaling [uniform|clustered|overlapping|moving] [MAX_SPHERES] [THREADS] [RAYS]
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "src/bvh.hh"
+#include "src/common.hh"
+#include "src/hittable.hh"
+#include "src/hittable_list.hh"
+#include "src/interval.hh"
+#include "src/ray.hh"
+#include "src/render_pool.hh"
+#include "src/scene_generator.hh"
+#include "src/vec3.hh"
+
+namespace {
+
+auto PeakResidentMiB() -> double {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_maxrss) / 1024;  // ru_maxrss is in KiB on Linux
+}
+
+auto Seconds(std::chrono::steady_clock::time_point start) -> double {
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Traces `ray_count` rays made by `make_ray(index)` and returns millions of rays per second.
+template <typename MakeRay>
+auto TraceRate(RenderPool& pool, uint64_t ray_count, const MakeRay& make_ray) -> double {
+  constexpr uint64_t kChunk = 4096;
+  std::atomic<uint64_t> hits{0};
+  const auto start = std::chrono::steady_clock::now();
+  pool.Run((ray_count + kChunk - 1) / kChunk, [&](size_t chunk, const Hittable& world) {
+    uint64_t chunk_hits = 0;
+    for (uint64_t k = chunk * kChunk; k < std::min(ray_count, (chunk + 1) * kChunk); k++) {
+      HitRecord rec;
+      chunk_hits += world.Hit(make_ray(k), Interval(0.001, kInfinity), rec) ? 1 : 0;
+    }
+    hits += chunk_hits;
+  });
+  const double seconds = Seconds(start);
+  if (hits == 0) {
+    std::cerr << "No ray hit the scene\n";
+  }
+  return static_cast<double>(ray_count) / seconds * 1e-6;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const std::string_view variant = args.size() > 1 ? args[1] : "uniform";
+  const auto max_spheres = static_cast<size_t>(args.size() > 2 ? std::stoull(args[2]) : 1000000);
+  const int threads = args.size() > 3 ? std::stoi(args[3]) : 0;
+  const auto ray_count = static_cast<uint64_t>(args.size() > 4 ? std::stoull(args[4]) : 1000000);
+
+  SceneParameters parameters;
+  parameters.thread_count = threads;
+  if (variant == "clustered") {
+    parameters.layout = SceneLayout::kClustered;
+  } else if (variant == "overlapping") {
+    parameters.layout = SceneLayout::kOverlapping;
+  } else if (variant == "moving") {
+    parameters.moving = true;
+  } else if (variant != "uniform") {
+    std::cerr << "Unknown variant: " << variant << '\n';
+    return 1;
+  }
+
+  const double baseline_mib = PeakResidentMiB();
+  std::cout << std::setw(11) << "spheres" << std::setw(12) << "generate s" << std::setw(10)
+            << "build s" << std::setw(11) << "peak MiB" << std::setw(11) << "B/sphere"
+            << std::setw(15) << "camera Mray/s" << std::setw(19) << "incoherent Mray/s" << '\n';
+  for (double size = 1000; size <= static_cast<double>(max_spheres) * 1.01;
+       size *= std::sqrt(10.0)) {
+    parameters.sphere_count = static_cast<size_t>(std::round(size));
+
+    auto start = std::chrono::steady_clock::now();
+    HittableList scene = GeneratedScene(parameters);
+    const double generate_seconds = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    const HittableList world(std::make_shared<BVHNode>(std::move(scene), threads));
+    const double build_seconds = Seconds(start);
+    const double peak_mib = PeakResidentMiB();
+
+    // Camera rays from where the renderer looks at the generated scene, in a 40 degree square.
+    const double side = GeneratedFieldSide(parameters.sphere_count);
+    const Point3 eye(0.6 * side, 2 + (0.15 * side), 0.6 * side);
+    const Vec3 w = UnitVector(eye - Point3(0, 0, 0));
+    const Vec3 u = UnitVector(Cross(Vec3(0, 1, 0), w));
+    const Vec3 v = Cross(w, u);
+    const double half_width = std::tan(DegreeToRadians(20));
+    const auto grid = static_cast<uint64_t>(std::sqrt(static_cast<double>(ray_count)));
+    auto camera_ray = [&](uint64_t k) {
+      const double x = ((2.0 * static_cast<double>(k % grid) / grid) - 1) * half_width;
+      const double y = ((2.0 * static_cast<double>(k / grid) / grid) - 1) * half_width;
+      return Ray(eye, (x * u) + (y * v) - w, 0.5);
+    };
+    // Random rays from just above the field.
+    auto incoherent_ray = [&](uint64_t k) {
+      ObjectRandom random(1, 0, k);
+      const Point3 origin(side * (random.Next() - 0.5), random.Next(0, 2),
+                          side * (random.Next() - 0.5));
+      const double z = random.Next(-1, 1);
+      const double r = std::sqrt(1 - (z * z));
+      const double phi = 2 * kPi * random.Next();
+      return Ray(origin, Vec3(r * std::cos(phi), r * std::sin(phi), z), random.Next());
+    };
+
+    RenderPool pool(world, threads, NumaMode::kOff);
+    const double camera_rate = TraceRate(pool, grid * grid, camera_ray);
+    const double incoherent_rate = TraceRate(pool, ray_count, incoherent_ray);
+
+    std::cout << std::setw(11) << parameters.sphere_count << std::fixed << std::setprecision(3)
+              << std::setw(12) << generate_seconds << std::setw(10) << build_seconds
+              << std::setprecision(1) << std::setw(11) << peak_mib << std::setw(11)
+              << (peak_mib - baseline_mib) * 1024 * 1024 / static_cast<double>(size)
+              << std::setprecision(2) << std::setw(15) << camera_rate << std::setw(19)
+              << incoherent_rate << std::defaultfloat << '\n'
+              << std::flush;
+  }
+}
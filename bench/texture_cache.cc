@@ -0,0 +1,100 @@
+// Renders the textured scene with a set of generated textures under different texture cache
+// budgets, with lookups filtered by the ray footprint and with every lookup in the full-resolution
+// level, and prints the hit rate, the bytes read from disk and the render time of each.
+//
+// Usage: texture_cache [TEXTURES] [TEXTURE_SIZE] [WIDTH] [SPP] [THREADS]
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "src/bvh.hh"
+#include "src/camera.hh"
+#include "src/color.hh"
+#include "src/hittable_list.hh"
+#include "src/scenes.hh"
+#include "src/texture.hh"
+#include "src/texture_cache.hh"
+
+namespace {
+
+auto GenerateTexture(uint32_t size, int seed) -> std::vector<Color> {
+  // A checkerboard in a per-texture hue with fine stripes, so every mip level has detail.
+  std::vector<Color> pixels(static_cast<size_t>(size) * size);
+  const Color hue(0.5 + (0.5 * std::sin(seed)), 0.5 + (0.5 * std::sin(seed + 2.1)),
+                  0.5 + (0.5 * std::sin(seed + 4.2)));
+  for (uint32_t y = 0; y < size; y++) {
+    for (uint32_t x = 0; x < size; x++) {
+      const bool check = ((x / (size / 16)) + (y / (size / 16))) % 2 == 0;
+      const double stripe = 0.75 + (0.25 * std::sin(static_cast<double>(x + (2 * y)) * 0.7));
+      pixels[(static_cast<size_t>(y) * size) + x] =
+          stripe * (check ? hue : Color(0.9, 0.9, 0.9) - (0.5 * hue));
+    }
+  }
+  return pixels;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  const int texture_count = args.size() > 1 ? std::stoi(args[1]) : 8;
+  const auto texture_size = static_cast<uint32_t>(args.size() > 2 ? std::stoul(args[2]) : 2048);
+  const int width = args.size() > 3 ? std::stoi(args[3]) : 400;
+  const int spp = args.size() > 4 ? std::stoi(args[4]) : 4;
+  const int threads = args.size() > 5 ? std::stoi(args[5]) : 0;
+
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "texture_cache_bench";
+  std::filesystem::create_directories(directory);
+  std::vector<std::string> paths;
+  uint64_t disk_bytes = 0;
+  for (int k = 0; k < texture_count; k++) {
+    const auto path = (directory / ("texture" + std::to_string(k) + ".rttx")).string();
+    const std::vector<Color> pixels = GenerateTexture(texture_size, k);
+    if (!WriteTiledTexture(path, texture_size, texture_size, pixels, 64)) {
+      std::cerr << "Failed to write " << path << "\n";
+      return 1;
+    }
+    disk_bytes += std::filesystem::file_size(path);
+    paths.push_back(path);
+  }
+  std::cout << texture_count << " textures of " << texture_size << "x" << texture_size << ", "
+            << (disk_bytes >> 20U) << " MiB on disk\n";
+
+  for (const bool mip_mapped : {true, false}) {
+    for (const size_t budget_mb : {4, 16, 64, 256}) {
+      const auto cache = std::make_shared<TextureCache>(budget_mb * 1024 * 1024);
+      std::vector<std::shared_ptr<Texture>> textures;
+      for (const auto& path : paths) {
+        textures.push_back(std::make_shared<ImageTexture>(cache, cache->Open(path), mip_mapped));
+      }
+      const HittableList world(std::make_shared<BVHNode>(TexturedScene(textures)));
+
+      Camera cam;
+      cam.SetAspectRatio(16.0 / 9.0);
+      cam.SetImageWidth(width);
+      cam.SetSamplePerPixel(spp);
+      cam.SetMaxDepth(10);
+      cam.SetVFov(40);
+      cam.SetLookFrom(Point3{0, 3, 8});
+      cam.SetLookAt(Point3{0, 1, -6});
+      cam.SetThreadCount(threads);
+
+      const auto start = std::chrono::steady_clock::now();
+      cam.Accumulate(world);
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << (mip_mapped ? "mip-mapped, " : "full resolution, ") << budget_mb
+                << " MiB budget, " << elapsed.count() << " s: ";
+      cache->Report(std::cout);
+    }
+  }
+  std::filesystem::remove_all(directory);
+}
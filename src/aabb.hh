@@ -35,7 +35,10 @@ class AABB {
     return x_;
   }
 
-  [[nodiscard]] auto Hit(const Ray& r, Interval ray_t) const -> bool {
+  [[nodiscard]] auto Hit(const Ray& r, Interval ray_t) const -> bool { return Clip(r, ray_t); }
+
+  // Narrows ray_t to the part of the ray inside the box. Returns false if no part is.
+  auto Clip(const Ray& r, Interval& ray_t) const -> bool {
     const Point3& ray_orig = r.Origin();
     const Vec3& ray_dir = r.Direction();
 
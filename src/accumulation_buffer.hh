@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "color.hh"
+#include "common.hh"
+
+// First-hit surface attributes of a sample (the albedo/normal/depth AOVs), which guide the
+// denoiser. Summed per pixel like radiance.
+struct SurfaceFeatures {
+  Color albedo;
+  Vec3 normal;
+  double depth{};
+
+  auto operator+=(const SurfaceFeatures& other) -> SurfaceFeatures& {
+    albedo += other.albedo;
+    normal += other.normal;
+    depth += other.depth;
+    return *this;
+  }
+};
+
+// Sums over the samples one render tile took of a pixel.
+struct PixelSums {
+  Color radiance;
+  double luminance_squared{};  // Second moment of the sample luminance, for variance estimates
+  SurfaceFeatures features;
+
+  auto AddSample(const Color& sample) -> void {
+    radiance += sample;
+    const double luminance = Luminance(sample);
+    luminance_squared += luminance * luminance;
+  }
+};
+
+// Linear (pre-gamma) radiance sums and sample counts for every pixel of an in-progress render.
+// Serialized to disk it doubles as the render checkpoint: a restarted render resumes from it, and
+// buffers rendered independently (different seeds, different machines) can be merged.
+class AccumulationBuffer {
+ public:
+  AccumulationBuffer() = default;
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  AccumulationBuffer(int width, int height, uint64_t seed)
+      : width_(width),
+        height_(height),
+        seed_(seed),
+        sums_(static_cast<size_t>(width) * height * 3, 0.0F),
+        moments_(static_cast<size_t>(width) * height, 0.0F),
+        features_(static_cast<size_t>(width) * height * kFeatureFloats, 0.0F),
+        counts_(static_cast<size_t>(width) * height, 0) {}
+
+  [[nodiscard]] auto Width() const -> int { return width_; }
+  [[nodiscard]] auto Height() const -> int { return height_; }
+  [[nodiscard]] auto Seed() const -> uint64_t { return seed_; }
+  [[nodiscard]] auto Empty() const -> bool { return counts_.empty(); }
+  // Whether the moment and feature sums cover every sample, so that Variance() and
+  // AverageFeatures() can guide the denoiser. Buffers resumed or merged from version 1
+  // checkpoints, which had neither, never get them back.
+  [[nodiscard]] auto HasGuides() const -> bool { return has_guides_; }
+
+  // Number of samples per pixel every pixel has completed. Together with the seed this is the
+  // whole RNG state of the renderer, since each pass reseeds from (seed, pixel, sample index).
+  [[nodiscard]] auto SamplesDone() const -> uint32_t { return samples_done_; }
+  auto SetSamplesDone(uint32_t samples) -> void { samples_done_ = samples; }
+
+  auto Add(int i, int j, const PixelSums& sums, uint32_t samples) -> void {
+    const size_t index = Index(i, j);
+    sums_[(3 * index) + 0] += static_cast<float>(sums.radiance.X());
+    sums_[(3 * index) + 1] += static_cast<float>(sums.radiance.Y());
+    sums_[(3 * index) + 2] += static_cast<float>(sums.radiance.Z());
+    moments_[index] += static_cast<float>(sums.luminance_squared);
+    const SurfaceFeatures& features = sums.features;
+    const size_t base = kFeatureFloats * index;
+    for (int k = 0; k < 3; k++) {
+      features_[base + k] += static_cast<float>(features.albedo[k]);
+      features_[base + 3 + k] += static_cast<float>(features.normal[k]);
+    }
+    features_[base + 6] += static_cast<float>(features.depth);
+    counts_[index] += samples;
+  }
+
+  [[nodiscard]] auto Samples(int i, int j) const -> uint32_t { return counts_[Index(i, j)]; }
+
+  [[nodiscard]] auto Average(int i, int j) const -> Color {
+    // Returns the mean linear radiance of pixel (i, j).
+    const size_t index = Index(i, j);
+    if (counts_[index] == 0) {
+      return {0, 0, 0};
+    }
+    const double scale = 1.0 / counts_[index];
+    return scale * Color(sums_[(3 * index) + 0], sums_[(3 * index) + 1], sums_[(3 * index) + 2]);
+  }
+
+  [[nodiscard]] auto Variance(int i, int j) const -> double {
+    // Estimated variance of the pixel's mean luminance.
+    const size_t index = Index(i, j);
+    if (counts_[index] < 2 || !has_guides_) {
+      return 0.0;
+    }
+    const double n = counts_[index];
+    const double mean = Luminance(Average(i, j));
+    return std::max(0.0, (moments_[index] / n) - (mean * mean)) / (n - 1);
+  }
+
+  [[nodiscard]] auto AverageFeatures(int i, int j) const -> SurfaceFeatures {
+    const size_t index = Index(i, j);
+    if (counts_[index] == 0) {
+      return {};
+    }
+    const double scale = 1.0 / counts_[index];
+    const size_t base = kFeatureFloats * index;
+    auto feature = [&](size_t k) -> double { return features_[base + k]; };
+    return {.albedo = scale * Color(feature(0), feature(1), feature(2)),
+            .normal = scale * Vec3(feature(3), feature(4), feature(5)),
+            .depth = scale * feature(6)};
+  }
+
+  [[nodiscard]] auto Image() const -> std::vector<Color> {
+    // Mean linear radiance of all pixels, row by row.
+    std::vector<Color> image;
+    image.reserve(counts_.size());
+    for (int j = 0; j < height_; j++) {
+      for (int i = 0; i < width_; i++) {
+        image.push_back(Average(i, j));
+      }
+    }
+    return image;
+  }
+
+  [[nodiscard]] auto VarianceImage() const -> std::vector<double> {
+    std::vector<double> image;
+    image.reserve(counts_.size());
+    for (int j = 0; j < height_; j++) {
+      for (int i = 0; i < width_; i++) {
+        image.push_back(Variance(i, j));
+      }
+    }
+    return image;
+  }
+
+  [[nodiscard]] auto FeatureImage() const -> std::vector<SurfaceFeatures> {
+    std::vector<SurfaceFeatures> image;
+    image.reserve(counts_.size());
+    for (int j = 0; j < height_; j++) {
+      for (int i = 0; i < width_; i++) {
+        image.push_back(AverageFeatures(i, j));
+      }
+    }
+    return image;
+  }
+
+  auto WriteImage(std::ostream& out) const -> void { WritePpm(out, width_, height_, Image()); }
+
+  auto Merge(const AccumulationBuffer& other) -> bool {
+    // Adds the samples of an independently rendered buffer of the same size to this one. A
+    // buffer rendered with the same seed holds the same samples, which would count twice without
+    // lowering the noise, so it is refused.
+    if (other.width_ != width_ || other.height_ != height_ || other.seed_ == seed_) {
+      return false;
+    }
+    for (size_t k = 0; k < sums_.size(); k++) {
+      sums_[k] += other.sums_[k];
+    }
+    for (size_t k = 0; k < moments_.size(); k++) {
+      moments_[k] += other.moments_[k];
+    }
+    for (size_t k = 0; k < features_.size(); k++) {
+      features_[k] += other.features_[k];
+    }
+    for (size_t k = 0; k < counts_.size(); k++) {
+      counts_[k] += other.counts_[k];
+    }
+    samples_done_ += other.samples_done_;
+    has_guides_ = has_guides_ && other.has_guides_;
+    // The merged sample streams no longer follow from a single seed, so resuming must not replay
+    // either of them.
+    seed_ = MixBits(seed_ ^ MixBits(other.seed_));
+    return true;
+  }
+
+  [[nodiscard]] auto Save(const std::string& path) const -> bool {
+    // Write to a temporary file and rename it, so an interrupted save never clobbers the last
+    // good checkpoint.
+    const std::string tmp_path = path + ".tmp";
+    {
+      std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        return false;
+      }
+      const Header header{.magic = kMagic,
+                          .version = kVersion,
+                          .width = static_cast<uint32_t>(width_),
+                          .height = static_cast<uint32_t>(height_),
+                          .samples_done = samples_done_,
+                          .flags = has_guides_ ? 0U : kNoGuides,
+                          .seed = seed_};
+      Write(out, &header, sizeof(header));
+      Write(out, counts_.data(), counts_.size() * sizeof(uint32_t));
+      Write(out, sums_.data(), sums_.size() * sizeof(float));
+      Write(out, moments_.data(), moments_.size() * sizeof(float));
+      Write(out, features_.data(), features_.size() * sizeof(float));
+      if (!out.flush()) {
+        return false;
+      }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+  }
+
+  static auto Load(const std::string& path) -> std::optional<AccumulationBuffer> {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      return std::nullopt;
+    }
+    Header header{};
+    if (!Read(in, &header, sizeof(header)) || header.magic != kMagic || header.version < 1 ||
+        header.version > kVersion) {
+      return std::nullopt;
+    }
+    // The size must be sane and match the file before anything is allocated for it. Version 1
+    // checkpoints predate the moment and feature buffers, which load as zero.
+    constexpr uint32_t kMaxSide = std::numeric_limits<int>::max();
+    if (header.width == 0 || header.height == 0 || header.width > kMaxSide ||
+        header.height > kMaxSide) {
+      return std::nullopt;
+    }
+    const uint64_t pixels = uint64_t{header.width} * header.height;
+    const uint64_t pixel_bytes = sizeof(uint32_t) + (3 * sizeof(float)) +
+                                 (header.version >= 2 ? (1 + kFeatureFloats) * sizeof(float) : 0);
+    in.seekg(0, std::ios::end);
+    const auto file_bytes = static_cast<uint64_t>(in.tellg());
+    if (pixels > (file_bytes - sizeof(header)) / pixel_bytes ||
+        file_bytes != sizeof(header) + (pixels * pixel_bytes)) {
+      return std::nullopt;
+    }
+    in.seekg(sizeof(header));
+
+    AccumulationBuffer buffer(static_cast<int>(header.width), static_cast<int>(header.height),
+                              header.seed);
+    buffer.samples_done_ = header.samples_done;
+    buffer.has_guides_ = header.version >= 2 && (header.flags & kNoGuides) == 0;
+    if (!Read(in, buffer.counts_.data(), buffer.counts_.size() * sizeof(uint32_t)) ||
+        !Read(in, buffer.sums_.data(), buffer.sums_.size() * sizeof(float)) ||
+        (header.version >= 2 &&
+         (!Read(in, buffer.moments_.data(), buffer.moments_.size() * sizeof(float)) ||
+          !Read(in, buffer.features_.data(), buffer.features_.size() * sizeof(float))))) {
+      return std::nullopt;
+    }
+    return buffer;
+  }
+
+ private:
+  struct Header {
+    std::array<char, 4> magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t samples_done;
+    uint32_t flags;  // kNoGuides; zero in older version 2 checkpoints
+    uint64_t seed;
+  };
+
+  static constexpr uint32_t kNoGuides = 1;  // The moment and feature sums miss some samples
+
+  static constexpr std::array<char, 4> kMagic{'R', 'T', 'C', 'K'};
+  static constexpr uint32_t kVersion = 2;
+  static constexpr size_t kFeatureFloats = 7;  // Albedo RGB, normal XYZ, depth
+
+  [[nodiscard]] auto Index(int i, int j) const -> size_t {
+    return (static_cast<size_t>(j) * width_) + i;
+  }
+
+  static auto Write(std::ofstream& out, const void* data, size_t size) -> void {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+  }
+
+  static auto Read(std::ifstream& in, void* data, size_t size) -> bool {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size));
+    return static_cast<bool>(in);
+  }
+
+  int width_{};
+  int height_{};
+  uint64_t seed_{};
+  uint32_t samples_done_{};
+  bool has_guides_{true};        // See HasGuides()
+  std::vector<float> sums_;      // Linear RGB sums, three floats per pixel
+  std::vector<float> moments_;   // Sums of squared sample luminance, one float per pixel
+  std::vector<float> features_;  // SurfaceFeatures sums, kFeatureFloats per pixel
+  std::vector<uint32_t> counts_;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.hh"
+
+// A tileable 64x64 blue-noise mask: every value in [0, 1) appears once, and similar values are
+// spread apart, so thresholding it or offsetting per-pixel samples by it leaves no low-frequency
+// structure in the image.
+class BlueNoiseMask {
+ public:
+  static constexpr int kSize = 64;
+
+  static auto Get() -> const BlueNoiseMask& {
+    static const BlueNoiseMask kMask;
+    return kMask;
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] auto Value(int x, int y) const -> double {
+    return values_[Index(x & (kSize - 1), y & (kSize - 1))];
+  }
+
+ private:
+  static constexpr int kPixels = kSize * kSize;
+  static constexpr double kSigma = 1.5;  // Width of the Gaussian that measures clustering
+
+  BlueNoiseMask() {
+    // Void-and-cluster (Ulichney 1993). The energy of a pixel is the sum of a Gaussian over the
+    // set pixels around it on the torus. Pixels are ranked by repeatedly removing the tightest
+    // cluster from an even initial pattern, then filling the largest void until the mask is full.
+    std::array<double, kPixels> kernel{};
+    for (int dy = 0; dy < kSize; dy++) {
+      for (int dx = 0; dx < kSize; dx++) {
+        const int wx = std::min(dx, kSize - dx);
+        const int wy = std::min(dy, kSize - dy);
+        kernel[Index(dx, dy)] = std::exp(-((wx * wx) + (wy * wy)) / (2 * kSigma * kSigma));
+      }
+    }
+    std::vector<uint8_t> set(kPixels, 0);
+    std::vector<double> energy(kPixels, 0.0);
+    auto toggle = [&](int p, bool on) {
+      set[p] = on ? 1 : 0;
+      const double sign = on ? 1.0 : -1.0;
+      const int px = p % kSize;
+      const int py = p / kSize;
+      for (int q = 0; q < kPixels; q++) {
+        const int dx = ((q % kSize) - px) & (kSize - 1);
+        const int dy = ((q / kSize) - py) & (kSize - 1);
+        energy[q] += sign * kernel[Index(dx, dy)];
+      }
+    };
+    auto extreme = [&](bool tightest_cluster) {
+      // The set pixel with the highest energy, or the unset pixel with the lowest.
+      int best = -1;
+      for (int p = 0; p < kPixels; p++) {
+        if ((set[p] != 0) != tightest_cluster) {
+          continue;
+        }
+        if (best < 0 || (tightest_cluster ? energy[p] > energy[best] : energy[p] < energy[best])) {
+          best = p;
+        }
+      }
+      return best;
+    };
+
+    // Initial pattern: a tenth of the pixels at random, then relaxed by moving the tightest
+    // cluster into the largest void until that no longer changes anything.
+    constexpr int kInitial = kPixels / 10;
+    for (uint64_t k = 0; std::count(set.begin(), set.end(), 1) < kInitial; k++) {
+      const int p = static_cast<int>(MixBits(k) % kPixels);
+      if (set[p] == 0) {
+        toggle(p, true);
+      }
+    }
+    for (;;) {
+      const int cluster = extreme(true);
+      toggle(cluster, false);
+      const int void_pixel = extreme(false);
+      toggle(void_pixel, true);
+      if (void_pixel == cluster) {
+        break;
+      }
+    }
+
+    std::vector<int> rank(kPixels, 0);
+    const std::vector<uint8_t> initial = set;
+    const std::vector<double> initial_energy = energy;
+    for (int r = kInitial - 1; r >= 0; r--) {
+      const int cluster = extreme(true);
+      toggle(cluster, false);
+      rank[cluster] = r;
+    }
+    set = initial;
+    energy = initial_energy;
+    for (int r = kInitial; r < kPixels; r++) {
+      const int void_pixel = extreme(false);
+      toggle(void_pixel, true);
+      rank[void_pixel] = r;
+    }
+    for (int p = 0; p < kPixels; p++) {
+      values_[p] = (rank[p] + 0.5) / kPixels;
+    }
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static constexpr auto Index(int x, int y) -> size_t {
+    return (static_cast<size_t>(y) * kSize) + x;
+  }
+
+  std::array<double, kPixels> values_{};
+};
@@ -2,7 +2,12 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "aabb.hh"
@@ -14,38 +19,31 @@
 
 class BVHNode : public Hittable {
  public:
-  explicit BVHNode(HittableList list) : BVHNode(list.Objects(), 0, list.Objects().size()) {
-    // There's a C++ subtlety here. This constructor (without span indices) creates an
-    // implicit copy of the hittable list, which we will modify. The lifetime of the copied
-    // list only extends until this constructor exists. That's OK, because we only need to
-    // persist the resulting bounding volume hierarchy.
+  // `thread_count` threads build the subtrees below the top levels side by side; 0 uses every
+  // available core. The tree is the same for any thread count.
+  explicit BVHNode(HittableList list, int thread_count = 1) : bbox_(AABB::Empty()) {
+    const std::vector<std::shared_ptr<Hittable>>& objects = list.Objects();
+    // Each object's box is computed once up front, rather than twice in every comparison of
+    // every sort on the way down.
+    std::vector<AABB> boxes(objects.size());
+    for (size_t k = 0; k < objects.size(); k++) {
+      boxes[k] = objects[k]->BoundingBox();
+    }
+    std::vector<uint32_t> order(objects.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (thread_count <= 0) {
+      thread_count = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+    }
+    Build(objects, boxes, order, thread_count);
   }
 
-  // NOLINTNEXTLINE(misc-no-recursion)
-  BVHNode(std::vector<std::shared_ptr<Hittable>>& objects, size_t start, size_t end)
+  // The subtree over objects[order[k]] for every k, where boxes[i] is the bounding box of
+  // objects[i]. Reorders `order`.
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  BVHNode(std::span<const std::shared_ptr<Hittable>> objects, std::span<const AABB> boxes,
+          std::span<uint32_t> order, int thread_count)
       : bbox_(AABB::Empty()) {
-    // Build the bounding box of the span of source objects.
-    for (size_t object_index = start; object_index < end; object_index++) {
-      bbox_ = AABB(bbox_, objects[object_index]->BoundingBox());
-    }
-    const int axis = bbox_.LongestAxis();
-
-    // NOLINTNEXTLINE(readability-avoid-nested-conditional-operator)
-    const auto comparator = (axis == 0) ? BoxXCompare : (axis == 1) ? BoxYCompare : BoxZCompare;
-
-    const size_t object_span = end - start;
-    if (object_span == 1) {
-      left_ = right_ = objects[start];
-    } else if (object_span == 2) {
-      left_ = objects[start];
-      right_ = objects[start + 1];
-    } else {
-      std::sort(std::begin(objects) + static_cast<int>(start),
-                std::begin(objects) + static_cast<int>(end), comparator);
-      const auto mid = start + (object_span / 2);
-      left_ = std::make_shared<BVHNode>(objects, start, mid);
-      right_ = std::make_shared<BVHNode>(objects, mid, end);
-    }
+    Build(objects, boxes, order, thread_count);
   }
 
   auto Hit(const Ray& r, const Interval& ray_t, HitRecord& rec) const -> bool override {
@@ -59,31 +57,70 @@ class BVHNode : public Hittable {
     return hit_left || hit_right;
   }
 
+  // NOLINTNEXTLINE(misc-no-recursion)
+  [[nodiscard]] auto Occluded(const Ray& r, const Interval& ray_t) const -> bool override {
+    // Any hit will do, so the right subtree is skipped as soon as the left one blocks the ray.
+    if (!bbox_.Hit(r, ray_t)) {
+      return false;
+    }
+    return left_->Occluded(r, ray_t) || (right_ != left_ && right_->Occluded(r, ray_t));
+  }
+
   [[nodiscard]] auto BoundingBox() const -> AABB override { return bbox_; }
 
- private:
-  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-  static auto BoxCompare(const std::shared_ptr<Hittable>& a, const std::shared_ptr<Hittable>& b,
-                         int axis_index) -> bool {
-    const auto a_axis_interval = a->BoundingBox().AxisInterval(axis_index);
-    const auto b_axis_interval = b->BoundingBox().AxisInterval(axis_index);
-    return a_axis_interval.Min() < b_axis_interval.Min();
-  }
+  [[nodiscard]] auto HasMotion() const -> bool override { return has_motion_; }
 
-  static auto BoxXCompare(const std::shared_ptr<Hittable>& a, const std::shared_ptr<Hittable>& b)
-      -> bool {
-    return BoxCompare(a, b, 0);
-  }
-  static auto BoxYCompare(const std::shared_ptr<Hittable>& a, const std::shared_ptr<Hittable>& b)
-      -> bool {
-    return BoxCompare(a, b, 1);
+  // NOLINTNEXTLINE(misc-no-recursion)
+  [[nodiscard]] auto Clone() const -> std::shared_ptr<Hittable> override {
+    auto copy = std::make_shared<BVHNode>(*this);
+    copy->left_ = left_->Clone();
+    copy->right_ = (right_ == left_) ? copy->left_ : right_->Clone();
+    return copy;
   }
-  static auto BoxZCompare(const std::shared_ptr<Hittable>& a, const std::shared_ptr<Hittable>& b)
-      -> bool {
-    return BoxCompare(a, b, 2);
+
+ private:
+  // Subtrees smaller than this are built on the thread that reaches them.
+  static constexpr size_t kMinParallelSpan = 4096;
+
+  // NOLINTNEXTLINE(misc-no-recursion)
+  auto Build(std::span<const std::shared_ptr<Hittable>> objects, std::span<const AABB> boxes,
+             std::span<uint32_t> order, int thread_count) -> void {
+    // Build the bounding box of the span of source objects.
+    for (const uint32_t object : order) {
+      bbox_ = AABB(bbox_, boxes[object]);
+    }
+    const int axis = bbox_.LongestAxis();
+
+    if (order.size() == 1) {
+      left_ = right_ = objects[order[0]];
+    } else if (order.size() == 2) {
+      left_ = objects[order[0]];
+      right_ = objects[order[1]];
+    } else {
+      std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return boxes[a].AxisInterval(axis).Min() < boxes[b].AxisInterval(axis).Min();
+      });
+      const size_t mid = order.size() / 2;
+      if (thread_count > 1 && order.size() >= kMinParallelSpan) {
+        // The left half goes to a new thread with half of the threads; this one keeps the rest.
+        std::shared_ptr<Hittable> left;
+        std::thread builder([&] {
+          left = std::make_shared<BVHNode>(objects, boxes, order.first(mid), thread_count / 2);
+        });
+        right_ = std::make_shared<BVHNode>(objects, boxes, order.subspan(mid),
+                                           thread_count - (thread_count / 2));
+        builder.join();
+        left_ = std::move(left);
+      } else {
+        left_ = std::make_shared<BVHNode>(objects, boxes, order.first(mid), 1);
+        right_ = std::make_shared<BVHNode>(objects, boxes, order.subspan(mid), 1);
+      }
+    }
+    has_motion_ = left_->HasMotion() || right_->HasMotion();
   }
 
   std::shared_ptr<Hittable> left_;
   std::shared_ptr<Hittable> right_;
   AABB bbox_;
+  bool has_motion_{};
 };
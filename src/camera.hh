@@ -1,14 +1,30 @@
 #pragma once
 
 #include <algorithm>
-#include <future>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "accumulation_buffer.hh"
 #include "color.hh"
 #include "common.hh"
 #include "hittable.hh"
 #include "material.hh"
+#include "perf_counters.hh"
 #include "ray.hh"
+#include "ray_sort.hh"
+#include "render_pool.hh"
+#include "sampler.hh"
 #include "vec3.hh"
 
 class Camera {
@@ -23,8 +39,9 @@ class Camera {
       for (int i = 0; i < image_width_; i++) {
         Color pixel_color(0, 0, 0);
         for (int sample = 0; sample < samples_per_pixel_; sample++) {
-          const Ray r = GetRay(i, j);
-          pixel_color += RayColor(r, max_depth_, world);
+          Sampler sampler = MakeSampler(i, j, sample);
+          const Ray r = GetRay<true, true>(i, j, sampler);
+          pixel_color += RayColor(r, sampler, max_depth_, world);
         }
         WriteColor(std::cout, pixel_samples_scale_ * pixel_color);
       }
@@ -33,47 +50,125 @@ class Camera {
   }
 
   auto RenderParallel(const Hittable& world) -> void {
-    Initialize();
-    std::clog << "Available Cores: " << std::thread::hardware_concurrency() << "\n";
-    std::cout << "P3\n" << image_width_ << ' ' << image_height_ << "\n255\n";
+    Accumulate(world);
+    accumulation_.WriteImage(std::cout);
+  }
 
-    std::vector<std::vector<Color>> pixels_height(image_height_);
-    std::vector<Color> pixels_width(image_width_);
+  auto Accumulate(const Hittable& world) -> void {
+    // Renders up to samples_per_pixel_ samples into the accumulation buffer without writing the
+    // image.
+    const TileKernel kernel = BeginRender(world);
+    RenderPool pool(world, thread_count_, numa_mode_);
+    if (log_progress_) {
+      std::clog << "Available Cores: " << std::thread::hardware_concurrency()
+                << ", render threads: " << pool.ThreadCount() << "\n";
+    }
 
-    // Workers for calculating pixel colors
-    std::vector<std::future<Color>> workers(image_width_);
-    auto worker_thread = [&](int t_i, int t_j) {
-      Color pixel_color(0, 0, 0);
-      for (int sample = 0; sample < samples_per_pixel_; sample++) {
-        const Ray r = GetRay(t_i, t_j);
-        pixel_color += RayColor(r, max_depth_, world);
+    // Render in passes of `checkpoint_interval_` samples per pixel, saving the accumulation
+    // buffer after each one so that an interrupted render loses at most one pass.
+    const auto target = static_cast<uint32_t>(samples_per_pixel_);
+    const auto pass_samples =
+        static_cast<uint32_t>(checkpoint_interval_ > 0 ? checkpoint_interval_ : samples_per_pixel_);
+    while (accumulation_.SamplesDone() < target) {
+      const uint32_t first_sample = accumulation_.SamplesDone();
+      const uint32_t last_sample = std::min(target, first_sample + pass_samples);
+      RenderPass(pool, kernel, first_sample, last_sample);
+      if (Cancelled()) {
+        return;  // The buffer holds part of a pass; the caller discards it
       }
-      return pixel_color;
-    };
+      accumulation_.SetSamplesDone(last_sample);
 
-    for (int j = 0; j < image_height_; j++) {
-      std::clog << "\rScanlines remaining: " << (image_height_ - j) << ' ' << std::flush;
-      // Calculate each pixel colors in row
-      for (int i = 0; i < image_width_; i++) {
-        workers[i] = std::async(std::launch::async, worker_thread, i, j);
-      }
-      // Wait for all workers
-      try {
-        for (int i = 0; i < image_width_; i++) {
-          pixels_width[i] = workers[i].get();
+      if (!checkpoint_path_.empty()) {
+        if (accumulation_.Save(checkpoint_path_)) {
+          std::clog << "\rCheckpoint: " << last_sample << '/' << target << " samples saved to "
+                    << checkpoint_path_ << '\n';
+        } else {
+          std::cerr << "Failed to write checkpoint " << checkpoint_path_ << '\n';
         }
-      } catch (std::runtime_error& e) {
-        std::cerr << e.what() << "\n";
       }
-      pixels_height[j] = pixels_width;
     }
-    // Write out all pixes colors
-    for (const auto& j : pixels_height) {
-      for (const auto& i : j) {
-        WriteColor(std::cout, pixel_samples_scale_ * i);
-      }
+
+    if (!log_progress_) {
+      return;
     }
     std::clog << "\rDone.                 \n";
+    if (numa_mode_ != NumaMode::kOff) {
+      pool.ReportScaling(std::clog);
+    }
+    if (bounce_stats_) {
+      bounce_stats_->Report(std::clog);
+    }
+  }
+
+  // Renders several views of one scene, such as the angles of a turntable or the two eyes of a
+  // stereo pair, into each view's accumulation buffer. The tiles of all views are handed out by
+  // one pool, so no thread idles at the end of one view while another still has tiles left. Each
+  // view renders its remaining samples in one pass and saves its checkpoint, if it has a path, at
+  // the end; the views' own thread counts and NUMA modes give way to the pool's.
+  static auto AccumulateViews(const Hittable& world, std::span<Camera> views, int thread_count,
+                              NumaMode numa_mode) -> void {
+    RenderPool pool(world, thread_count, numa_mode);
+    const bool log_progress = std::any_of(views.begin(), views.end(),
+                                          [](const Camera& view) { return view.log_progress_; });
+    if (log_progress) {
+      std::clog << "Available Cores: " << std::thread::hardware_concurrency()
+                << ", render threads: " << pool.ThreadCount() << ", views: " << views.size()
+                << "\n";
+    }
+
+    std::vector<TileKernel> kernels;
+    std::vector<size_t> first_tile{0};  // Of each view in the tiles of all views
+    for (Camera& view : views) {
+      kernels.push_back(view.BeginRender(world));
+      first_tile.push_back(first_tile.back() + view.TileCount());
+    }
+    size_t tiles_remaining = first_tile.back();
+    std::mutex progress_mutex;
+
+    pool.Run(first_tile.back(), [&](size_t tile, const Hittable& replica) {
+      const auto k = static_cast<size_t>(
+          std::upper_bound(first_tile.begin(), first_tile.end(), tile) - first_tile.begin() - 1);
+      Camera& view = views[k];
+      view.RenderPassTile(replica, kernels[k], tile - first_tile[k],
+                          view.accumulation_.SamplesDone(),
+                          static_cast<uint32_t>(view.samples_per_pixel_));
+      if (log_progress) {
+        const std::scoped_lock lock(progress_mutex);
+        std::clog << "\rTiles remaining: " << --tiles_remaining << ' ' << std::flush;
+      }
+    });
+
+    for (Camera& view : views) {
+      if (view.Cancelled()) {
+        continue;
+      }
+      view.accumulation_.SetSamplesDone(static_cast<uint32_t>(view.samples_per_pixel_));
+      if (!view.checkpoint_path_.empty() && !view.accumulation_.Save(view.checkpoint_path_)) {
+        std::cerr << "Failed to write checkpoint " << view.checkpoint_path_ << '\n';
+      }
+    }
+    if (log_progress) {
+      std::clog << "\rDone.                 \n";
+    }
+  }
+
+  [[nodiscard]] auto Accumulation() const -> const AccumulationBuffer& { return accumulation_; }
+
+  [[nodiscard]] auto ImageWidth() const -> int { return image_width_; }
+  [[nodiscard]] auto ImageHeight() const -> int {
+    return std::max(1, static_cast<int>(image_width_ / aspect_ratio_));
+  }
+  [[nodiscard]] auto SamplesPerPixel() const -> int { return samples_per_pixel_; }
+
+  auto LoadCheckpoint(const std::string& path) -> bool {
+    // Resume from (or add more samples to) a previously saved accumulation buffer.
+    auto buffer = AccumulationBuffer::Load(path);
+    if (!buffer) {
+      return false;
+    }
+    accumulation_ = std::move(*buffer);
+    seed_ = accumulation_.Seed();
+    return true;
   }
 
   constexpr auto SetAspectRatio(double ratio) -> void { aspect_ratio_ = ratio; }
@@ -88,10 +183,37 @@ class Camera {
   constexpr auto SetVUp(Vec3 vec) -> void { v_up_ = vec; }
   constexpr auto SetDefocusAngle(double defocus_angle) -> void { defocus_angle_ = defocus_angle; }
   constexpr auto SetFocusDist(double focus_dist) -> void { focus_dist_ = focus_dist; };
+  constexpr auto SetSeed(uint64_t seed) -> void { seed_ = seed; }
+  auto SetCheckpointPath(std::string path) -> void { checkpoint_path_ = std::move(path); }
+  constexpr auto SetCheckpointInterval(int samples) -> void { checkpoint_interval_ = samples; }
+  constexpr auto SetThreadCount(int threads) -> void { thread_count_ = threads; }
+  constexpr auto SetNumaMode(NumaMode mode) -> void { numa_mode_ = mode; }
+  constexpr auto SetRayOrder(RayOrder order) -> void { ray_order_ = order; }
+  constexpr auto SetSampler(SamplerKind kind) -> void { sampler_ = kind; }
+  constexpr auto SetPerfProfile(PerfProfile* profile) -> void { perf_profile_ = profile; }
+  constexpr auto SetLights(const Hittable* lights) -> void { lights_ = lights; }
+  constexpr auto SetBackground(const Color& color) -> void { background_ = color; }
+  constexpr auto SetCancelFlag(const std::atomic<bool>* cancel) -> void { cancel_ = cancel; }
+  constexpr auto SetLogProgress(bool log) -> void { log_progress_ = log; }
+  constexpr auto SetKernelSpecialization(bool specialize) -> void {
+    specialize_kernels_ = specialize;
+  }
+  // Called with the corner of every tile once its samples are in the accumulation buffer, from
+  // the render thread that rendered it.
+  auto SetTileCallback(std::function<void(int, int)> callback) -> void {
+    tile_callback_ = std::move(callback);
+  }
 
  private:
+  static constexpr int kTileSize = 16;      // Width and height of a render tile in pixels
+  static constexpr double kFarDepth = 1e6;  // Depth AOV of rays that escape to the background
+  // Most paths a wavefront tile traces at once; tiles with more samples trace them in batches.
+  static constexpr size_t kMaxWavefrontPaths = 8192;
+  // Spread of the ray cone after a diffuse bounce, in radians.
+  static constexpr double kDiffuseConeSpread = 0.1;
+
   auto Initialize() -> void {
-    image_height_ = std::max(1, static_cast<int>(image_width_ / aspect_ratio_));
+    image_height_ = ImageHeight();
     pixel_samples_scale_ = 1.0 / samples_per_pixel_;
 
     center_ = look_from_;
@@ -124,51 +246,463 @@ class Camera {
     const double defocus_radius = focus_dist_ * std::tan(DegreeToRadians(defocus_angle_ / 2));
     defocus_disk_u_ = u_ * defocus_radius;
     defocus_disk_v_ = v_ * defocus_radius;
+
+    // Angle a pixel subtends, the spread of the camera's ray cones.
+    pixel_spread_ = pixel_delta_u_.Length() / focus_dist_;
+  }
+
+  // Renders samples [first_sample, last_sample) of the tile at (x0, y0).
+  using TileKernel = void (Camera::*)(const Hittable&, int, int, uint32_t, uint32_t);
+
+  [[nodiscard]] auto SelectTileKernel(const Hittable& world) const -> TileKernel {
+    // The kernels are compiled for each combination of defocus and motion blur, and the render
+    // picks the one it needs once, so a pinhole camera or a scene at rest pays nothing for them.
+    const bool thin_lens = !specialize_kernels_ || defocus_angle_ > 0;
+    const bool motion_blur = !specialize_kernels_ || world.HasMotion();
+    if (thin_lens) {
+      return motion_blur ? &Camera::RenderTileKernel<true, true>
+                         : &Camera::RenderTileKernel<true, false>;
+    }
+    return motion_blur ? &Camera::RenderTileKernel<false, true>
+                       : &Camera::RenderTileKernel<false, false>;
+  }
+
+  template <bool kThinLens, bool kMotionBlur>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto RenderTileKernel(const Hittable& world, int x0, int y0, uint32_t first_sample,
+                        uint32_t last_sample) -> void {
+    if (ray_order_ == RayOrder::kPixel) {
+      RenderTile<kThinLens, kMotionBlur>(world, x0, y0, first_sample, last_sample);
+    } else {
+      RenderTileWavefront<kThinLens, kMotionBlur>(world, x0, y0, first_sample, last_sample);
+    }
+  }
+
+  // Sets up the camera and the accumulation buffer for a render, and picks its tile kernel.
+  auto BeginRender(const Hittable& world) -> TileKernel {
+    Initialize();
+    bounce_stats_ =
+        (ray_order_ == RayOrder::kPixel) ? nullptr : std::make_shared<BounceStats>(max_depth_);
+
+    if (accumulation_.Width() != image_width_ || accumulation_.Height() != image_height_) {
+      if (!accumulation_.Empty()) {
+        std::cerr << "Checkpoint size does not match the image; starting over.\n";
+      }
+      accumulation_ = AccumulationBuffer(image_width_, image_height_, seed_);
+    }
+    return SelectTileKernel(world);
+  }
+
+  [[nodiscard]] auto TilesX() const -> int { return (image_width_ + kTileSize - 1) / kTileSize; }
+  [[nodiscard]] auto TileCount() const -> size_t {
+    return static_cast<size_t>(TilesX()) * ((image_height_ + kTileSize - 1) / kTileSize);
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto RenderPassTile(const Hittable& world, TileKernel kernel, size_t tile, uint32_t first_sample,
+                      uint32_t last_sample) -> void {
+    if (Cancelled()) {
+      return;
+    }
+    const int x0 = static_cast<int>(tile % TilesX()) * kTileSize;
+    const int y0 = static_cast<int>(tile / TilesX()) * kTileSize;
+    const ScopedPerfRegion region(perf_profile_, x0, y0);
+    (this->*kernel)(world, x0, y0, first_sample, last_sample);
+    if (tile_callback_) {
+      tile_callback_(x0, y0);
+    }
+  }
+
+  auto RenderPass(RenderPool& pool, TileKernel kernel, uint32_t first_sample, uint32_t last_sample)
+      -> void {
+    // Adds samples [first_sample, last_sample) to every pixel of the accumulation buffer.
+    const size_t tile_count = TileCount();
+    size_t tiles_remaining = tile_count;
+    std::mutex progress_mutex;
+
+    pool.Run(tile_count, [&](size_t tile, const Hittable& world) {
+      RenderPassTile(world, kernel, tile, first_sample, last_sample);
+      if (log_progress_) {
+        const std::scoped_lock lock(progress_mutex);
+        std::clog << "\rTiles remaining: " << --tiles_remaining << ' ' << std::flush;
+      }
+    });
+  }
+
+  [[nodiscard]] auto Cancelled() const -> bool {
+    return cancel_ != nullptr && cancel_->load(std::memory_order_relaxed);
+  }
+
+  template <bool kThinLens, bool kMotionBlur>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto RenderTile(const Hittable& world, int x0, int y0, uint32_t first_sample,
+                  uint32_t last_sample) -> void {
+    for (int j = y0; j < std::min(y0 + kTileSize, image_height_); j++) {
+      for (int i = x0; i < std::min(x0 + kTileSize, image_width_); i++) {
+        // Seeding from (seed, pixel, first sample) makes each pass reproducible, so a resumed
+        // render continues the sample sequence instead of repeating the samples already taken.
+        const auto pixel = (static_cast<uint64_t>(j) * image_width_) + i;
+        SeedRandom(seed_ ^ MixBits(pixel ^ MixBits(first_sample)));
+        PixelSums sums;
+        for (uint32_t sample = first_sample; sample < last_sample; sample++) {
+          Sampler sampler = MakeSampler(i, j, sample);
+          const Ray r = GetRay<kThinLens, kMotionBlur>(i, j, sampler);
+          sums.AddSample(RayColor(r, sampler, max_depth_, world, &sums.features));
+        }
+        accumulation_.Add(i, j, sums, last_sample - first_sample);
+      }
+    }
+  }
+
+  template <bool kThinLens, bool kMotionBlur>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto RenderTileWavefront(const Hittable& world, int x0, int y0, uint32_t first_sample,
+                           uint32_t last_sample) -> void {
+    // Traces the samples of the tile one bounce at a time, in batches of at most
+    // kMaxWavefrontPaths paths so that memory does not grow with the samples per pixel. The paths
+    // of a batch share one random sequence, seeded from the tile's first pixel and the batch's
+    // first sample.
+    const int x1 = std::min(x0 + kTileSize, image_width_);
+    const int y1 = std::min(y0 + kTileSize, image_height_);
+    std::vector<PixelSums> pixels(static_cast<size_t>(x1 - x0) * (y1 - y0));
+    const auto batch_samples =
+        static_cast<uint32_t>(std::max<size_t>(1, kMaxWavefrontPaths / pixels.size()));
+    WavefrontScratch scratch;
+    scratch.paths.reserve(pixels.size() * std::min(batch_samples, last_sample - first_sample));
+    for (uint32_t batch_first = first_sample; batch_first < last_sample;
+         batch_first += batch_samples) {
+      const uint32_t batch_last = std::min(last_sample, batch_first + batch_samples);
+      TraceWavefrontBatch<kThinLens, kMotionBlur>(world, x0, y0, batch_first, batch_last, pixels,
+                                                  scratch);
+    }
+
+    for (int j = y0; j < y1; j++) {
+      for (int i = x0; i < x1; i++) {
+        const int pixel = ((j - y0) * (x1 - x0)) + (i - x0);
+        accumulation_.Add(i, j, pixels[pixel], last_sample - first_sample);
+      }
+    }
   }
 
-  // NOLINTNEXTLINE(misc-no-recursion)
-  static auto RayColor(const Ray& r, int depth, const Hittable& world) -> Color {
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0) {
-      return {0, 0, 0};
+  // The values a camera ray is made from, in the order GetRay draws them.
+  struct CameraSample {
+    Sample2D offset;  // Within the pixel
+    Sample2D lens;    // Warped to the defocus disk
+    double time;
+  };
+
+  // Buffers of a wavefront tile, kept from one batch to the next.
+  struct WavefrontScratch {
+    std::vector<PathState> paths;
+    std::vector<PathState> next;
+    std::vector<CameraSample> cameras;
+    std::vector<Ray> rays;
+    std::vector<HitRecord> recs;
+    std::vector<uint8_t> hits;
+    // Samples warped together, one array per coordinate: the lens samples of the camera rays,
+    // then the cosine-weighted directions of each bounce, where `warped` holds every path's index
+    // into them (or kNotWarped).
+    std::vector<double> u;
+    std::vector<double> v;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+    std::vector<uint32_t> warped;
+  };
+  static constexpr uint32_t kNotWarped = UINT32_MAX;
+
+  // Traces samples [first_sample, last_sample) of the tile at (x0, y0) to the end of their paths
+  // and adds them to `pixels`.
+  template <bool kThinLens, bool kMotionBlur>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto TraceWavefrontBatch(const Hittable& world, int x0, int y0, uint32_t first_sample,
+                           uint32_t last_sample, std::vector<PixelSums>& pixels,
+                           WavefrontScratch& scratch) -> void {
+    const int x1 = std::min(x0 + kTileSize, image_width_);
+    const int y1 = std::min(y0 + kTileSize, image_height_);
+    const auto tile_pixel = (static_cast<uint64_t>(y0) * image_width_) + x0;
+    SeedRandom(seed_ ^ MixBits(tile_pixel ^ MixBits(first_sample)));
+    auto& [paths, next, cameras, rays, recs, hits, u, v, x, y, z, warped] = scratch;
+    paths.clear();
+    cameras.clear();
+    for (int j = y0; j < y1; j++) {
+      for (int i = x0; i < x1; i++) {
+        for (uint32_t sample = first_sample; sample < last_sample; sample++) {
+          Sampler sampler = MakeSampler(i, j, sample);
+          cameras.push_back(DrawCameraSample<kThinLens, kMotionBlur>(sampler));
+          paths.push_back({.ray = {},
+                           .cone_spread = pixel_spread_,
+                           .pixel = ((j - y0) * (x1 - x0)) + (i - x0),
+                           .sampler = sampler});
+        }
+      }
+    }
+    if constexpr (kThinLens) {
+      u.clear();
+      v.clear();
+      for (const auto& camera : cameras) {
+        u.push_back(camera.lens.u);
+        v.push_back(camera.lens.v);
+      }
+      x.resize(u.size());
+      y.resize(u.size());
+      SampleUniformDisk(u, v, x, y);
+    }
+    for (size_t k = 0; k < paths.size(); k++) {
+      const int i = x0 + (paths[k].pixel % (x1 - x0));
+      const int j = y0 + (paths[k].pixel / (x1 - x0));
+      if constexpr (kThinLens) {
+        paths[k].ray = CameraRay<true>(i, j, cameras[k], x[k], y[k]);
+      } else {
+        paths[k].ray = CameraRay<false>(i, j, cameras[k], 0, 0);
+      }
     }
 
+    for (int depth = 0; depth < max_depth_ && !paths.empty(); depth++) {
+      // Camera rays are already coherent; the bounces after them are not.
+      if (depth > 0 && ray_order_ == RayOrder::kSorted) {
+        SortPaths(paths, next);
+      }
+      const auto start = std::chrono::steady_clock::now();
+      // The whole bounce is intersected as one batch before any of it is shaded, which lets
+      // scenes such as paged ones order the traversal to suit themselves.
+      rays.clear();
+      for (const auto& path : paths) {
+        rays.push_back(path.ray);
+      }
+      recs.resize(paths.size());
+      hits.resize(paths.size());
+      world.HitBatch(rays, Interval(0.001, kInfinity), recs, hits);
+      // Scatter draws nothing else on such surfaces, so their directions can be drawn and warped
+      // ahead of the shading.
+      u.clear();
+      v.clear();
+      warped.assign(paths.size(), kNotWarped);
+      for (size_t k = 0; k < paths.size(); k++) {
+        if (hits[k] != 0 && recs[k].Mat()->ScattersCosineWeighted()) {
+          warped[k] = static_cast<uint32_t>(u.size());
+          const Sample2D sample = paths[k].sampler.Next2D();
+          u.push_back(sample.u);
+          v.push_back(sample.v);
+        }
+      }
+      x.resize(u.size());
+      y.resize(u.size());
+      z.resize(u.size());
+      SampleCosineHemisphere(u, v, x, y, z);
+      next.clear();
+      for (size_t k = 0; k < paths.size(); k++) {
+        PathState& path = paths[k];
+        SurfaceFeatures* first_hit = (depth == 0) ? &pixels[path.pixel].features : nullptr;
+        const uint32_t w = warped[k];
+        const Vec3 direction = w != kNotWarped ? Vec3(x[w], y[w], z[w]) : Vec3();
+        if (ShadeHit(path, world, hits[k] != 0 ? &recs[k] : nullptr, first_hit,
+                     w != kNotWarped ? &direction : nullptr)) {
+          next.push_back(path);
+        } else {
+          pixels[path.pixel].AddSample(path.radiance);
+        }
+      }
+      bounce_stats_->Record(depth, paths.size(), std::chrono::steady_clock::now() - start);
+      std::swap(paths, next);
+    }
+    // Paths cut off by the bounce limit keep what they gathered so far.
+    for (const auto& path : paths) {
+      pixels[path.pixel].AddSample(path.radiance);
+    }
+  }
+
+  auto RayColor(const Ray& r, const Sampler& sampler, int depth, const Hittable& world,
+                SurfaceFeatures* features = nullptr) const -> Color {
+    // Returns the radiance along r, and adds its first-hit surface features to `features`.
+    PathState path{.ray = r, .cone_spread = pixel_spread_, .sampler = sampler};
+    if (depth > 0 && ExtendPath(path, world, features)) {
+      // If we've exceeded the ray bounce limit, no more light is gathered.
+      for (depth--; depth > 0 && ExtendPath(path, world, nullptr); depth--) {
+      }
+    }
+    return path.radiance;
+  }
+
+  auto ExtendPath(PathState& path, const Hittable& world, SurfaceFeatures* first_hit) const
+      -> bool {
+    // Traces one bounce of the path, adding any light it gathers to path.radiance. Returns false
+    // once the path has terminated. On a camera ray, `first_hit` receives the features of the
+    // visible surface.
     HitRecord rec;
-    if (world.Hit(r, Interval(0.001, kInfinity), rec)) {
-      Ray scattered;
-      Color attenuation;
-      if (rec.Mat()->Scatter(r, rec, attenuation, scattered)) {
-        return attenuation * RayColor(scattered, depth - 1, world);
+    const bool hit = world.Hit(path.ray, Interval(0.001, kInfinity), rec);
+    return ShadeHit(path, world, hit ? &rec : nullptr, first_hit);
+  }
+
+  auto ShadeHit(PathState& path, const Hittable& world, HitRecord* hit,
+                SurfaceFeatures* first_hit, const Vec3* cosine_direction = nullptr) const -> bool {
+    // The rest of ExtendPath once the path's ray has been intersected with the world: `hit` is
+    // where it hit, or null if it escaped. `cosine_direction`, if not null, is the direction
+    // already drawn for a surface that scatters cosine-weighted.
+    if (hit == nullptr) {
+      const Color background = Background(path.ray);
+      if (first_hit != nullptr) {
+        *first_hit += {.albedo = background, .normal = Vec3(0, 0, 0), .depth = kFarDepth};
       }
-      return {0, 0, 0};
+      path.radiance += path.throughput * background;
+      return false;
+    }
+    HitRecord& rec = *hit;
+    const Material& mat = *rec.Mat();
+    SetFootprint(path, rec);
+    if (first_hit != nullptr) {
+      *first_hit += {.albedo = mat.Albedo(rec),
+                     .normal = rec.Normal(),
+                     .depth = rec.T() * path.ray.Direction().Length()};
+    }
+
+    const Color emitted = mat.Emitted(rec);
+    if (!emitted.NearZero()) {
+      // An emitter found by the scattered ray. The light sampling at the previous bounce could
+      // have found it too, so its share is weighted against that (multiple importance sampling).
+      const bool sampled_lights = lights_ != nullptr && path.scatter_pdf > 0;
+      const double weight =
+          sampled_lights ? PowerHeuristic(path.scatter_pdf, lights_->PdfValue(path.ray)) : 1.0;
+      path.radiance += weight * path.throughput * emitted;
+    }
+
+    Ray scattered;
+    Color attenuation;
+    const bool scatters =
+        cosine_direction != nullptr
+            ? mat.ScatterCosine(path.ray, rec, *cosine_direction, attenuation, scattered)
+            : mat.Scatter(path.ray, rec, attenuation, scattered, path.sampler);
+    if (!scatters) {
+      return false;
+    }
+    path.scatter_pdf = 0;
+    if (mat.HasScatteringPdf()) {
+      if (lights_ != nullptr) {
+        SampleLights(path, world, rec, attenuation);
+      }
+      path.scatter_pdf = mat.ScatteringPdf(path.ray, rec, scattered);
+      // A diffuse bounce scatters over the whole hemisphere; the next hit only needs a coarse
+      // texture lookup.
+      path.cone_spread = std::max(path.cone_spread, kDiffuseConeSpread);
+    }
+    path.throughput = path.throughput * attenuation;
+    path.ray = scattered;
+    return true;
+  }
+
+  auto SampleLights(PathState& path, const Hittable& world, const HitRecord& rec,
+                    const Color& attenuation) const -> void {
+    // Next-event estimation: adds the light arriving at rec from a direction sampled towards the
+    // lights, if nothing blocks it, weighted against finding the same light by scattering.
+    const double time = path.ray.Time();
+    const Ray shadow(rec.P(), lights_->Random(rec.P(), time, path.sampler), time);
+    HitRecord light_rec;
+    if (!lights_->Hit(shadow, Interval(0.001, kInfinity), light_rec)) {
+      return;
+    }
+    const Color emitted = light_rec.Mat()->Emitted(light_rec);
+    const double light_pdf = lights_->PdfValue(shadow);
+    const double scatter_pdf = rec.Mat()->ScatteringPdf(path.ray, rec, shadow);
+    if (emitted.NearZero() || light_pdf <= 0 || scatter_pdf <= 0) {
+      return;
+    }
+    // The shadow ray only needs to know whether anything lies in front of the light.
+    if (world.Occluded(shadow, Interval(0.001, light_rec.T() * (1 - 1e-6)))) {
+      return;
+    }
+    const double weight = PowerHeuristic(light_pdf, scatter_pdf);
+    path.radiance += (weight * scatter_pdf / light_pdf) * path.throughput * attenuation * emitted;
+  }
+
+  static auto SetFootprint(PathState& path, HitRecord& rec) -> void {
+    // Grows the ray cone (Akenine-Moller et al. 2019) to the hit point and projects its width
+    // onto the surface, in texture space. Specular bounces keep the cone's spread, as off a flat
+    // mirror.
+    const double distance = rec.T() * path.ray.Direction().Length();
+    path.cone_width += path.cone_spread * distance;
+    if (rec.UVScale() > 0) {
+      const double cos_theta =
+          std::fabs(Dot(rec.Normal(), path.ray.Direction())) / path.ray.Direction().Length();
+      rec.SetUVFootprint(path.cone_width / (std::max(cos_theta, 0.05) * rec.UVScale()));
+    }
+  }
+
+  static auto PowerHeuristic(double pdf, double other_pdf) -> double {
+    // Veach's power heuristic (beta = 2) for one sample from each of two strategies.
+    return (pdf * pdf) / ((pdf * pdf) + (other_pdf * other_pdf));
+  }
+
+  [[nodiscard]] auto Background(const Ray& r) const -> Color {
+    if (background_) {
+      return *background_;
     }
     const Vec3 unit_direction = UnitVector(r.Direction());
     const double a = 0.5 * (unit_direction.Y() + 1.0);
     return (1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
   }
 
-  auto GetRay(int i, int j) -> Ray {
+  [[nodiscard]] auto MakeSampler(int i, int j, uint32_t sample) const -> Sampler {
+    return {sampler_, seed_, i, j, sample, static_cast<uint32_t>(samples_per_pixel_)};
+  }
+
+  template <bool kThinLens, bool kMotionBlur>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto GetRay(int i, int j, Sampler& sampler) const -> Ray {
     // Construct a camera ray originating from the defocus disk and directed at randomly sampled
     // point around the pixel location (i, j).
-    const Vec3 offset = SampleSquare();
+    const CameraSample sample = DrawCameraSample<kThinLens, kMotionBlur>(sampler);
+    Vec3 disk_point;
+    if constexpr (kThinLens) {
+      disk_point = SampleUniformDisk(sample.lens);
+    }
+    return CameraRay<kThinLens>(i, j, sample, disk_point.X(), disk_point.Y());
+  }
+
+  template <bool kThinLens, bool kMotionBlur>
+  static auto DrawCameraSample(Sampler& sampler) -> CameraSample {
+    // Without defocus or motion blur the lens and time dimensions are skipped rather than drawn,
+    // so that the rest of the path uses the same dimensions whatever the camera settings.
+    CameraSample sample{.offset = sampler.Next2D(), .lens = {}, .time = 0};
+    if constexpr (kThinLens) {
+      sample.lens = sampler.Next2D();
+    } else {
+      sampler.Skip(2);
+    }
+    if constexpr (kMotionBlur) {
+      sample.time = sampler.Next1D();
+    } else {
+      sampler.Skip(1);
+    }
+    return sample;
+  }
+
+  // The ray through pixel (i, j) for `sample`, whose lens sample warps to (disk_x, disk_y) on
+  // the unit disk.
+  template <bool kThinLens>
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto CameraRay(int i, int j, const CameraSample& sample, double disk_x, double disk_y) const
+      -> Ray {
+    const Vec3 offset = SampleSquare(sample.offset);
     const Vec3 pixel_sample =
         pixel00_loc_ + ((i + offset.X()) * pixel_delta_u_) + ((j + offset.Y()) * pixel_delta_v_);
-
-    const Vec3 ray_origin = (defocus_angle_ <= 0) ? center_ : DefocusDiskSample();
-    const Vec3 ray_direction = pixel_sample - ray_origin;
-    const double ray_time = RandomDouble();
-    return {ray_origin, ray_direction, ray_time};
+    Point3 ray_origin = center_;
+    if constexpr (kThinLens) {
+      if (defocus_angle_ > 0) {
+        ray_origin = DefocusDiskPoint(disk_x, disk_y);
+      }
+    }
+    return {ray_origin, pixel_sample - ray_origin, sample.time};
   }
 
-  [[nodiscard]] static auto SampleSquare() -> Vec3 {
-    // Return the vector to a aa random point in the [-.5,-.5]-[+.5,+.5] unit square.
-    return {RandomDouble() - 0.5, RandomDouble() - 0.5, 0};
+  [[nodiscard]] static auto SampleSquare(Sample2D u) -> Vec3 {
+    // Return the vector to the point u in the [-.5,-.5]-[+.5,+.5] unit square.
+    return {u.u - 0.5, u.v - 0.5, 0};
   }
 
-  [[nodiscard]] auto DefocusDiskSample() const -> Vec3 {
-    // Return a random point in the camera defocus disk.
-    const auto p = RandomInUnitDisk();
-    return center_ + (p[0] * defocus_disk_u_) + (p[1] * defocus_disk_v_);
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] auto DefocusDiskPoint(double disk_x, double disk_y) const -> Vec3 {
+    // Return the point (disk_x, disk_y) of the unit disk maps to in the camera defocus disk.
+    return center_ + (disk_x * defocus_disk_u_) + (disk_y * defocus_disk_v_);
   }
 
   double aspect_ratio_{1.0};
@@ -184,6 +718,7 @@ class Camera {
   Vec3 u_, v_, w_;          // Camera frame basis vectors
   Vec3 defocus_disk_u_;     // Defocus disk horizontal radius
   Vec3 defocus_disk_v_;     // Defocus disk vertical radius
+  double pixel_spread_{};   // Angle subtended by one pixel
 
   double v_fov_{90};                   // Vertical view angle (field of view)
   Point3 look_from_{Point3(0, 0, 0)};  // Point camera is looking from
@@ -192,4 +727,24 @@ class Camera {
 
   double defocus_angle_{0};  // Variation angle of rays through each pixel
   double focus_dist_{10};    // Distance from camera lok_from point to plane of perfect focus
+
+  uint64_t seed_{0};                 // Base seed of the per-pixel sample streams
+  std::string checkpoint_path_;      // Where to save the accumulation buffer; empty disables
+  int checkpoint_interval_{0};       // Samples per pixel between checkpoints; 0 saves at the end
+  AccumulationBuffer accumulation_;  // Linear radiance sums of the render in progress
+
+  int thread_count_{0};                        // Render threads; 0 uses every available core
+  NumaMode numa_mode_{NumaMode::kOff};         // Pinning and scene replication across NUMA nodes
+  RayOrder ray_order_{RayOrder::kPixel};       // Order in which the rays of a tile are traced
+  SamplerKind sampler_{SamplerKind::kSobol};   // Sequence the sample values are drawn from
+  std::shared_ptr<BounceStats> bounce_stats_;  // Per-bounce ray rates of wavefront renders
+  PerfProfile* perf_profile_{};                // Receives per-tile counters; null disables
+  const std::atomic<bool>* cancel_{};          // Abandons the render once set; null disables
+  bool log_progress_{true};                    // Report progress and statistics to std::clog
+  bool specialize_kernels_{true};              // Leave out the ray features a render does not use
+
+  std::function<void(int, int)> tile_callback_;  // Called after every tile; empty disables
+
+  const Hittable* lights_{};          // Emitters sampled at each diffuse bounce; null disables
+  std::optional<Color> background_;  // Constant background; the sky gradient when unset
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <vector>
 
 #include "interval.hh"
 #include "vec3.hh"
@@ -33,3 +34,29 @@ constexpr void WriteColor(std::ostream& out, const Color& pixel_color) {
   // Write out the pixel color components.
   out << r_byte << ' ' << g_byte << ' ' << b_byte << '\n';
 }
+
+inline auto Luminance(const Color& c) -> double {
+  return (0.2126 * c.X()) + (0.7152 * c.Y()) + (0.0722 * c.Z());
+}
+
+inline auto WritePpm(std::ostream& out, int width, int height, const std::vector<Color>& pixels)
+    -> void {
+  // Write out row-major linear pixel colors as a PPM image.
+  out << "P3\n" << width << ' ' << height << "\n255\n";
+  for (size_t k = 0; k < static_cast<size_t>(width) * height; k++) {
+    WriteColor(out, pixels[k]);
+  }
+}
+
+inline auto WriteBinaryPpm(std::ostream& out, int width, int height,
+                           const std::vector<Color>& pixels) -> void {
+  // WritePpm in the binary P6 format, which is a third of the size and much faster to format.
+  static const Interval kIntensity(0.000, 0.999);
+  out << "P6\n" << width << ' ' << height << "\n255\n";
+  std::vector<char> bytes(3 * static_cast<size_t>(width) * height);
+  for (size_t k = 0; k < bytes.size(); k++) {
+    const double component = LinerToGamma(pixels[k / 3][static_cast<int>(k % 3)]);
+    bytes[k] = static_cast<char>(static_cast<int>(256 * kIntensity.Clamp(component)));
+  }
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
 #include <numbers>
 #include <random>
@@ -9,10 +10,31 @@ constexpr double kPi = std::numbers::pi;
 
 constexpr auto DegreeToRadians(double degrees) -> double { return degrees * kPi / 180.0; };
 
+inline auto RandomGenerator() -> std::mt19937& {
+  // Each thread owns its generator, so render workers never share (or race on) RNG state.
+  thread_local std::mt19937 generator{12345};  // NOLINT(cert-msc32-c,cert-msc51-cpp)
+  return generator;
+}
+
+constexpr auto MixBits(uint64_t x) -> uint64_t {
+  // SplitMix64 finalizer: turns structured keys (seed, pixel, sample) into well-spread seeds.
+  x ^= x >> 30U;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27U;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31U;
+  return x;
+}
+
+inline auto SeedRandom(uint64_t seed) -> void {
+  // Reseed the calling thread's generator.
+  RandomGenerator().seed(static_cast<std::mt19937::result_type>(MixBits(seed)));
+}
+
 inline auto RandomDouble() -> double {
-  static std::mt19937 generator{12345};  // NOLINT(cert-msc32-c,cert-msc51-cpp)
-  static std::uniform_real_distribution<double> distribution{0.0, 1.0};
-  return distribution(generator);
+  // Returns a random real in [0,1).
+  thread_local std::uniform_real_distribution<double> distribution{0.0, 1.0};
+  return distribution(RandomGenerator());
 }
 
 inline auto RandomDouble(double min, double max) -> double {
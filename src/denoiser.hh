@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "accumulation_buffer.hh"
+#include "color.hh"
+#include "vec3.hh"
+
+struct DenoiseOptions {
+  int iterations{4};            // Filter passes; pass k samples pixels 2^k apart
+  double sigma_luminance{2.0};  // Luminance difference tolerated, in standard deviations
+  double sigma_normal{1.0};     // Normal difference tolerated between neighbors
+  double sigma_depth{0.2};      // Relative depth difference tolerated per pixel of distance
+  double sigma_albedo{0.3};     // Albedo difference tolerated between neighbors
+  int thread_count{0};          // 0 uses every available core
+};
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto ParallelForTiles(int width, int height, int thread_count,
+                             const std::function<void(int, int, int, int)>& tile_fn) -> void {
+  // Calls tile_fn(x0, y0, x1, y1) for every 32x32 tile of the image on a set of threads.
+  constexpr int kTile = 32;
+  const int tiles_x = (width + kTile - 1) / kTile;
+  const int tile_count = tiles_x * ((height + kTile - 1) / kTile);
+  if (thread_count <= 0) {
+    thread_count = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+  }
+  std::atomic<int> next{0};
+  auto worker = [&] {
+    for (int tile = next++; tile < tile_count; tile = next++) {
+      const int x0 = (tile % tiles_x) * kTile;
+      const int y0 = (tile / tiles_x) * kTile;
+      tile_fn(x0, y0, std::min(x0 + kTile, width), std::min(y0 + kTile, height));
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int k = 1; k < std::min(thread_count, tile_count); k++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the first-hit albedo,
+// normal and depth buffers, with the luminance weight scaled by each pixel's estimated variance
+// as in SVGF (Schied et al. 2017): noisy pixels are smoothed hard, converged ones are left
+// alone. The radiance is divided by the albedo before filtering so that texture and material
+// detail survive, and multiplied back afterwards.
+// NOLINTNEXTLINE(readability-function-cognitive-complexity)
+inline auto Denoise(int width, int height, const std::vector<Color>& color,
+                    const std::vector<double>& variance,
+                    const std::vector<SurfaceFeatures>& features, const DenoiseOptions& options)
+    -> std::vector<Color> {
+  constexpr double kMinAlbedo = 0.01;
+  constexpr std::array<double, 5> kKernel{1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16};
+  auto clamped_albedo = [&](size_t k) {
+    const Color& a = features[k].albedo;
+    return Color(std::max(a.X(), kMinAlbedo), std::max(a.Y(), kMinAlbedo),
+                 std::max(a.Z(), kMinAlbedo));
+  };
+  auto index = [width](int x, int y) { return (static_cast<size_t>(y) * width) + x; };
+
+  std::vector<Color> current(color.size());
+  std::vector<double> current_variance(color.size());
+  for (size_t k = 0; k < color.size(); k++) {
+    const Color a = clamped_albedo(k);
+    current[k] = Color(color[k].X() / a.X(), color[k].Y() / a.Y(), color[k].Z() / a.Z());
+    const double albedo_luminance = Luminance(a);
+    current_variance[k] = variance[k] / (albedo_luminance * albedo_luminance);
+  }
+  std::vector<Color> filtered(color.size());
+  std::vector<double> filtered_variance(color.size());
+
+  const double inv_normal = 1.0 / (options.sigma_normal * options.sigma_normal);
+  const double inv_albedo = 1.0 / (options.sigma_albedo * options.sigma_albedo);
+  for (int level = 0; level < options.iterations; level++) {
+    const int step = 1 << level;
+    ParallelForTiles(width, height, options.thread_count, [&](int x0, int y0, int x1, int y1) {
+      for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+          const size_t p = index(x, y);
+          const SurfaceFeatures& fp = features[p];
+
+          // A 3x3 blur of the variance keeps single outliers from dictating the weights.
+          double local_variance = 0;
+          double local_weight = 0;
+          for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+              const int qx = x + dx;
+              const int qy = y + dy;
+              if (qx >= 0 && qx < width && qy >= 0 && qy < height) {
+                const double h = kKernel[dx + 2] * kKernel[dy + 2];
+                local_variance += h * current_variance[index(qx, qy)];
+                local_weight += h;
+              }
+            }
+          }
+          const double luminance_scale =
+              (options.sigma_luminance * std::sqrt(local_variance / local_weight)) + 1e-6;
+          const double luminance_p = Luminance(current[p]);
+
+          Color sum(0, 0, 0);
+          double weight_sum = 0;
+          double variance_sum = 0;
+          for (int dy = -2; dy <= 2; dy++) {
+            const int qy = y + (dy * step);
+            if (qy < 0 || qy >= height) {
+              continue;
+            }
+            for (int dx = -2; dx <= 2; dx++) {
+              const int qx = x + (dx * step);
+              if (qx < 0 || qx >= width) {
+                continue;
+              }
+              const size_t q = index(qx, qy);
+              const SurfaceFeatures& fq = features[q];
+              const int pixel_distance = step * std::max({1, std::abs(dx), std::abs(dy)});
+              const double depth_scale =
+                  options.sigma_depth * std::max(fp.depth, 1e-3) * pixel_distance;
+              const double exponent =
+                  (std::fabs(luminance_p - Luminance(current[q])) / luminance_scale) +
+                  ((fp.normal - fq.normal).LengthSquared() * inv_normal) +
+                  ((fp.albedo - fq.albedo).LengthSquared() * inv_albedo) +
+                  (std::fabs(fp.depth - fq.depth) / depth_scale);
+              const double weight = kKernel[dx + 2] * kKernel[dy + 2] * std::exp(-exponent);
+              sum += weight * current[q];
+              weight_sum += weight;
+              variance_sum += weight * weight * current_variance[q];
+            }
+          }
+          filtered[p] = sum / weight_sum;
+          filtered_variance[p] = variance_sum / (weight_sum * weight_sum);
+        }
+      }
+    });
+    std::swap(current, filtered);
+    std::swap(current_variance, filtered_variance);
+  }
+
+  for (size_t k = 0; k < color.size(); k++) {
+    current[k] = current[k] * clamped_albedo(k);
+  }
+  return current;
+}
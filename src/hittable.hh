@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
 #include "aabb.hh"
 #include "interval.hh"
 #include "ray.hh"
+#include "sampler.hh"
 #include "vec3.hh"
 
 class Material;
@@ -16,7 +22,11 @@ class HitRecord {
   [[nodiscard]] auto Normal() const -> const Vec3& { return normal_; }
   [[nodiscard]] auto T() const -> double { return t_; }
   [[nodiscard]] auto FrontFace() const -> bool { return front_face_; }
-  [[nodiscard]] auto Mat() const -> std::shared_ptr<Material> { return mat_; }
+  [[nodiscard]] auto Mat() const -> const Material* { return mat_; }
+  [[nodiscard]] auto U() const -> double { return u_; }
+  [[nodiscard]] auto V() const -> double { return v_; }
+  [[nodiscard]] auto UVScale() const -> double { return uv_scale_; }
+  [[nodiscard]] auto UVFootprint() const -> double { return uv_footprint_; }
 
   // setter
   auto SetP(const Point3& p) -> void { p_ = p; }
@@ -28,7 +38,21 @@ class HitRecord {
     front_face_ = Dot(r.Direction(), outward_normal) < 0;
     normal_ = front_face_ ? outward_normal : -outward_normal;
   }
-  auto SetMaterial(std::shared_ptr<Material> mat) -> void { mat_ = std::move(mat); }
+  // A plain pointer: copying a shared_ptr on every hit would bounce its reference count between
+  // all render threads (and sockets).
+  auto SetMaterial(const Material* mat) -> void { mat_ = mat; }
+
+  // Surface coordinates of the hit point, and the world-space distance that one unit of u or v
+  // covers there (the smaller of the two), which converts a ray footprint into texture space.
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto SetUV(double u, double v, double uv_scale) -> void {
+    u_ = u;
+    v_ = v;
+    uv_scale_ = uv_scale;
+  }
+  // Width of the ray's footprint at the hit point in texture space, which selects the mip level
+  // of texture lookups; 0 samples the finest level.
+  auto SetUVFootprint(double footprint) -> void { uv_footprint_ = footprint; }
 
  private:
   Point3 p_;
@@ -36,8 +60,10 @@ class HitRecord {
   double t_{};
   double u_{};
   double v_{};
+  double uv_scale_{};
+  double uv_footprint_{};
   bool front_face_{};
-  std::shared_ptr<Material> mat_;
+  const Material* mat_{};
 };
 
 class Hittable {
@@ -51,5 +77,41 @@ class Hittable {
   virtual ~Hittable() = default;
   virtual auto Hit(const Ray& r, const Interval& ray_t, HitRecord& rec) const -> bool = 0;
 
+  // Closest hits of a batch of rays: hits[k] is 1 if rays[k] hits anything within ray_t, and
+  // recs[k] then describes the hit. Scenes that trace many rays together faster than one at a time
+  // override this.
+  virtual auto HitBatch(std::span<const Ray> rays, const Interval& ray_t, std::span<HitRecord> recs,
+                        std::span<uint8_t> hits) const -> void {
+    for (size_t k = 0; k < rays.size(); k++) {
+      hits[k] = Hit(rays[k], ray_t, recs[k]) ? 1 : 0;
+    }
+  }
+
+  // Whether anything blocks the ray within ray_t. Unlike Hit this may stop at the first
+  // intersection found instead of searching for the closest one, which is all a shadow ray needs.
+  [[nodiscard]] virtual auto Occluded(const Ray& r, const Interval& ray_t) const -> bool {
+    HitRecord rec;
+    return Hit(r, ray_t, rec);
+  }
+
   [[nodiscard]] virtual auto BoundingBox() const -> AABB = 0;
+
+  // Whether any part of the object moves during the shutter interval. The camera leaves ray times
+  // at 0 for scenes that are entirely at rest.
+  [[nodiscard]] virtual auto HasMotion() const -> bool { return false; }
+
+  // Deep copy of the object (materials are shared), used to place scene replicas in the memory of
+  // each NUMA node.
+  [[nodiscard]] virtual auto Clone() const -> std::shared_ptr<Hittable> = 0;
+
+  // Light sampling: the solid-angle density of Random() producing r's direction from r's origin
+  // (at r's time), and a random unit direction from `origin` towards the object. Objects that
+  // cannot be sampled return a density of 0.
+  [[nodiscard]] virtual auto PdfValue([[maybe_unused]] const Ray& r) const -> double { return 0; }
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] virtual auto Random([[maybe_unused]] const Point3& origin,
+                                    [[maybe_unused]] double time,
+                                    [[maybe_unused]] Sampler& sampler) const -> Vec3 {
+    return {1, 0, 0};
+  }
 };
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 
 #include "aabb.hh"
@@ -11,6 +16,12 @@ class HittableList : public Hittable {
  public:
   HittableList() = default;
   explicit HittableList(const std::shared_ptr<Hittable>& object) { Add(object); }
+  explicit HittableList(std::vector<std::shared_ptr<Hittable>> objects)
+      : objects_(std::move(objects)) {
+    for (const auto& object : objects_) {
+      bbox_ = AABB(bbox_, object->BoundingBox());
+    }
+  }
 
   auto Objects() -> std::vector<std::shared_ptr<Hittable>>& { return objects_; }
 
@@ -37,8 +48,56 @@ class HittableList : public Hittable {
     return hit_anything;
   }
 
+  // A list of one object, such as the list wrapping a scene's BVH, passes batches on to it.
+  auto HitBatch(std::span<const Ray> rays, const Interval& ray_t, std::span<HitRecord> recs,
+                std::span<uint8_t> hits) const -> void override {
+    if (objects_.size() == 1) {
+      objects_.front()->HitBatch(rays, ray_t, recs, hits);
+    } else {
+      Hittable::HitBatch(rays, ray_t, recs, hits);
+    }
+  }
+
+  [[nodiscard]] auto Occluded(const Ray& r, const Interval& ray_t) const -> bool override {
+    return std::ranges::any_of(objects_,
+                               [&](const auto& object) { return object->Occluded(r, ray_t); });
+  }
+
   [[nodiscard]] auto BoundingBox() const -> AABB override { return bbox_; }
 
+  [[nodiscard]] auto HasMotion() const -> bool override {
+    return std::ranges::any_of(objects_, [](const auto& object) { return object->HasMotion(); });
+  }
+
+  [[nodiscard]] auto Clone() const -> std::shared_ptr<Hittable> override {
+    auto copy = std::make_shared<HittableList>();
+    for (const auto& object : objects_) {
+      copy->Add(object->Clone());
+    }
+    return copy;
+  }
+
+  // As a set of lights: Random() picks one object uniformly and samples it, so the density of a
+  // direction is the average of the objects' densities.
+  [[nodiscard]] auto PdfValue(const Ray& r) const -> double override {
+    double sum = 0;
+    for (const auto& object : objects_) {
+      sum += object->PdfValue(r);
+    }
+    return objects_.empty() ? 0 : sum / static_cast<double>(objects_.size());
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] auto Random(const Point3& origin, double time, Sampler& sampler) const
+      -> Vec3 override {
+    if (objects_.empty()) {
+      return {1, 0, 0};
+    }
+    const auto count = objects_.size();
+    const auto pick = static_cast<size_t>(sampler.Next1D() * static_cast<double>(count));
+    return objects_[std::min(pick, count - 1)]->Random(origin, time, sampler);
+  }
+
  private:
   std::vector<std::shared_ptr<Hittable>> objects_;
   AABB bbox_;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "color.hh"
+
+// Error metrics of a rendered image against a reference, computed on display values (gamma 2,
+// clamped to [0, 1]) as they would be written out.
+
+inline auto DisplayValue(double linear_component) -> double {
+  return std::clamp(LinerToGamma(linear_component), 0.0, 1.0);
+}
+
+inline auto Psnr(const std::vector<Color>& image, const std::vector<Color>& reference) -> double {
+  // Peak signal-to-noise ratio in dB.
+  double squared_error = 0;
+  for (size_t k = 0; k < image.size(); k++) {
+    for (int c = 0; c < 3; c++) {
+      const double d = DisplayValue(image[k][c]) - DisplayValue(reference[k][c]);
+      squared_error += d * d;
+    }
+  }
+  const double mse = squared_error / (3.0 * static_cast<double>(image.size()));
+  return mse > 0 ? -10.0 * std::log10(mse) : std::numeric_limits<double>::infinity();
+}
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto Ssim(int width, int height, const std::vector<Color>& image,
+                 const std::vector<Color>& reference) -> double {
+  // Mean structural similarity of the luminance over 8x8 windows placed every 4 pixels.
+  constexpr int kWindow = 8;
+  constexpr int kStride = 4;
+  constexpr double kC1 = 0.01 * 0.01;
+  constexpr double kC2 = 0.03 * 0.03;
+  auto luminance = [](const Color& c) {
+    return Luminance(Color(DisplayValue(c.X()), DisplayValue(c.Y()), DisplayValue(c.Z())));
+  };
+
+  double ssim_sum = 0;
+  int windows = 0;
+  for (int y0 = 0; y0 + kWindow <= height; y0 += kStride) {
+    for (int x0 = 0; x0 + kWindow <= width; x0 += kStride) {
+      double sum_a = 0;
+      double sum_b = 0;
+      double sum_aa = 0;
+      double sum_bb = 0;
+      double sum_ab = 0;
+      for (int y = y0; y < y0 + kWindow; y++) {
+        for (int x = x0; x < x0 + kWindow; x++) {
+          const auto k = (static_cast<size_t>(y) * width) + x;
+          const double a = luminance(image[k]);
+          const double b = luminance(reference[k]);
+          sum_a += a;
+          sum_b += b;
+          sum_aa += a * a;
+          sum_bb += b * b;
+          sum_ab += a * b;
+        }
+      }
+      constexpr double kN = kWindow * kWindow;
+      const double mean_a = sum_a / kN;
+      const double mean_b = sum_b / kN;
+      const double var_a = (sum_aa / kN) - (mean_a * mean_a);
+      const double var_b = (sum_bb / kN) - (mean_b * mean_b);
+      const double cov = (sum_ab / kN) - (mean_a * mean_b);
+      ssim_sum += ((2 * mean_a * mean_b) + kC1) * ((2 * cov) + kC2) /
+                  (((mean_a * mean_a) + (mean_b * mean_b) + kC1) * (var_a + var_b + kC2));
+      windows++;
+    }
+  }
+  return windows > 0 ? ssim_sum / windows : 1.0;
+}
@@ -1,74 +1,658 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "accumulation_buffer.hh"
 #include "bvh.hh"
 #include "camera.hh"
-#include "common.hh"
+#include "color.hh"
+#include "denoiser.hh"
 #include "hittable_list.hh"
-#include "material.hh"
-#include "sphere.hh"
+#include "image_metrics.hh"
+#include "paged_scene.hh"
+#include "perf_counters.hh"
+#include "preview.hh"
+#include "ray_sort.hh"
+#include "render_pool.hh"
+#include "sampler.hh"
+#include "scene_generator.hh"
+#include "scenes.hh"
+#include "task_graph.hh"
+#include "texture.hh"
+#include "texture_cache.hh"
 #include "vec3.hh"
 
-// TODO: Remove NOLINT
-// NOLINTNEXTLINE(bugprone-exception-escape)
-auto main() -> int {
-  HittableList world;
+namespace {
 
-  const auto ground_material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-  world.Add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
-
-  for (int a = -11; a < 11; a++) {
-    for (int b = -11; b < 11; b++) {
-      auto choose_mat = RandomDouble();
-      const Point3 center(a + (0.9 * RandomDouble()), 0.2, b + (0.9 * RandomDouble()));
-
-      if ((center - Point3(4, 0.2, 0)).Length() > 0.9) {
-        std::shared_ptr<Material> sphere_material;
-
-        if (choose_mat < 0.8) {
-          // diffuse
-          auto albedo = Color::Random() * Color::Random();
-          sphere_material = std::make_shared<Lambertian>(albedo);
-          auto center2 = center + Vec3(0, RandomDouble(0, .5), 0);
-          world.Add(std::make_shared<Sphere>(center, center2, 0.2, sphere_material));
-        } else if (choose_mat < 0.95) {
-          // metal
-          auto albedo = Color::Random(0.5, 1);
-          auto fuzz = RandomDouble(0, 0.5);
-          sphere_material = std::make_shared<Metal>(albedo, fuzz);
-          world.Add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-        } else {
-          // glass
-          sphere_material = std::make_shared<Dielectric>(1.5);
-          world.Add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-        }
+enum class SceneKind {
+  kRandomSpheres,  // The final scene of the first book, lit by the sky
+  kIndoor,         // A closed room lit by small sphere lights
+  kTextured,       // Rows of spheres with image textures
+  kGenerated,      // A random sphere field of any size, for scaling tests
+};
+
+struct Options {
+  SceneKind scene{SceneKind::kRandomSpheres};
+  bool light_sampling{true};  // Sample the scene's lights directly at diffuse bounces
+  SceneParameters generator;  // Size and variant of the generated scene
+  std::string paged_scene_path;  // File to trace the generated scene from; empty keeps it in RAM
+  size_t page_budget_mb{256};    // Memory budget of the paged scene's resident pages and writer
+  bool treelet_queues{false};    // Trace the paged scene's pages one batch of rays at a time
+  std::vector<std::string> texture_paths;  // Tiled texture files of the textured scene
+  size_t texture_cache_mb{256};            // Memory budget of the texture cache
+  int image_width{400};
+  int samples_per_pixel{100};
+  uint64_t seed{0};
+  std::string checkpoint_path;
+  int checkpoint_interval{0};
+  bool resume{false};
+  std::string perf_json_path;  // Where to write hardware counter results; empty disables
+  bool denoise{false};
+  std::string reference_path;  // High-spp checkpoint to report image error against
+  int threads{0};
+  NumaMode numa_mode{NumaMode::kOff};
+  RayOrder ray_order{RayOrder::kPixel};
+  SamplerKind sampler{SamplerKind::kSobol};
+  std::vector<std::string> merge_inputs;  // Checkpoints to merge instead of rendering
+  std::string preview_target;  // File or unix:SOCKET for progressive frames; empty renders once
+  std::string views_path;      // File of views to render together; empty renders the one view
+};
+
+// One view of a batch render: where its image goes and how its camera differs from the scene's.
+struct View {
+  std::string output_path;
+  std::vector<std::function<void(Camera&)>> updates;
+};
+
+auto ParseOptions(std::span<char*> args, Options& options) -> bool {
+  for (size_t k = 1; k < args.size(); k++) {
+    const std::string_view arg{args[k]};
+    const bool has_value = k + 1 < args.size();
+    if (arg == "--scene" && has_value) {
+      const std::string_view scene{args[++k]};
+      if (scene == "spheres") {
+        options.scene = SceneKind::kRandomSpheres;
+      } else if (scene == "indoor") {
+        options.scene = SceneKind::kIndoor;
+      } else if (scene == "textured") {
+        options.scene = SceneKind::kTextured;
+      } else if (scene == "generated") {
+        options.scene = SceneKind::kGenerated;
+      } else {
+        std::cerr << "Unknown scene: " << scene << "\n";
+        return false;
+      }
+    } else if (arg == "--spheres" && has_value) {
+      options.generator.sphere_count = std::stoull(args[++k]);
+    } else if (arg == "--layout" && has_value) {
+      const std::string_view layout{args[++k]};
+      if (layout == "uniform") {
+        options.generator.layout = SceneLayout::kUniform;
+      } else if (layout == "clustered") {
+        options.generator.layout = SceneLayout::kClustered;
+      } else if (layout == "overlapping") {
+        options.generator.layout = SceneLayout::kOverlapping;
+      } else {
+        std::cerr << "Unknown layout: " << layout << "\n";
+        return false;
+      }
+    } else if (arg == "--moving") {
+      options.generator.moving = true;
+    } else if (arg == "--mixed-materials") {
+      options.generator.mixed_materials = true;
+    } else if (arg == "--paged-scene" && has_value) {
+      options.paged_scene_path = args[++k];
+    } else if (arg == "--page-budget-mb" && has_value) {
+      options.page_budget_mb = std::stoull(args[++k]);
+    } else if (arg == "--treelet-queues") {
+      options.treelet_queues = true;
+    } else if (arg == "--no-light-sampling") {
+      options.light_sampling = false;
+    } else if (arg == "--texture" && has_value) {
+      options.texture_paths.emplace_back(args[++k]);
+    } else if (arg == "--texture-cache-mb" && has_value) {
+      options.texture_cache_mb = std::stoull(args[++k]);
+    } else if (arg == "--width" && has_value) {
+      options.image_width = std::stoi(args[++k]);
+    } else if (arg == "--spp" && has_value) {
+      options.samples_per_pixel = std::stoi(args[++k]);
+    } else if (arg == "--seed" && has_value) {
+      options.seed = std::stoull(args[++k]);
+    } else if (arg == "--checkpoint" && has_value) {
+      options.checkpoint_path = args[++k];
+    } else if (arg == "--checkpoint-interval" && has_value) {
+      options.checkpoint_interval = std::stoi(args[++k]);
+    } else if (arg == "--resume") {
+      options.resume = true;
+    } else if (arg == "--denoise") {
+      options.denoise = true;
+    } else if (arg == "--reference" && has_value) {
+      options.reference_path = args[++k];
+    } else if (arg == "--perf-json" && has_value) {
+      options.perf_json_path = args[++k];
+    } else if (arg == "--threads" && has_value) {
+      options.threads = std::stoi(args[++k]);
+    } else if (arg == "--ray-order" && has_value) {
+      const std::string_view order{args[++k]};
+      if (order == "pixel") {
+        options.ray_order = RayOrder::kPixel;
+      } else if (order == "wavefront") {
+        options.ray_order = RayOrder::kWavefront;
+      } else if (order == "sorted") {
+        options.ray_order = RayOrder::kSorted;
+      } else {
+        std::cerr << "Unknown ray order: " << order << "\n";
+        return false;
+      }
+    } else if (arg == "--sampler" && has_value) {
+      const std::string_view sampler{args[++k]};
+      if (sampler == "random") {
+        options.sampler = SamplerKind::kRandom;
+      } else if (sampler == "stratified") {
+        options.sampler = SamplerKind::kStratified;
+      } else if (sampler == "sobol") {
+        options.sampler = SamplerKind::kSobol;
+      } else if (sampler == "bluenoise") {
+        options.sampler = SamplerKind::kBlueNoise;
+      } else {
+        std::cerr << "Unknown sampler: " << sampler << "\n";
+        return false;
+      }
+    } else if (arg == "--numa") {
+      options.numa_mode = NumaMode::kPin;
+    } else if (arg == "--numa-replicate") {
+      options.numa_mode = NumaMode::kReplicate;
+    } else if (arg == "--preview" && has_value) {
+      options.preview_target = args[++k];
+    } else if (arg == "--views" && has_value) {
+      options.views_path = args[++k];
+    } else if (arg == "--merge") {
+      while (k + 1 < args.size()) {
+        options.merge_inputs.emplace_back(args[++k]);
+      }
+    } else {
+      std::cerr << "Unknown or incomplete option: " << arg << "\n"
+                << "Usage: " << args[0]
+                << " [--scene spheres|indoor|textured|generated] [--spheres N]"
+                   " [--layout uniform|clustered|overlapping] [--moving] [--mixed-materials]"
+                   " [--paged-scene PATH] [--page-budget-mb N] [--treelet-queues]"
+                   " [--texture PATH...] [--texture-cache-mb N]"
+                   " [--no-light-sampling] [--width N] [--spp N]"
+                   " [--seed N] [--checkpoint PATH] [--checkpoint-interval N]"
+                   " [--resume] [--threads N] [--numa | --numa-replicate]"
+                   " [--ray-order pixel|wavefront|sorted]"
+                   " [--sampler random|stratified|sobol|bluenoise] [--perf-json PATH] [--denoise]"
+                   " [--reference CHECKPOINT] [--preview PATH|unix:PATH] [--views PATH]"
+                   " [--merge CHECKPOINT...]\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+auto MergeCheckpoints(const Options& options) -> int {
+  // Combine independently rendered sample passes into one image (and one checkpoint, if a
+  // --checkpoint path is given, so further samples can be added to the result).
+  AccumulationBuffer merged;
+  std::vector<uint64_t> seeds;
+  for (const auto& path : options.merge_inputs) {
+    auto buffer = AccumulationBuffer::Load(path);
+    if (!buffer) {
+      std::cerr << "Failed to read checkpoint " << path << "\n";
+      return 1;
+    }
+    if (std::find(seeds.begin(), seeds.end(), buffer->Seed()) != seeds.end()) {
+      std::cerr << "Checkpoint " << path << " has the seed of an earlier one, so it repeats its"
+                << " samples; render each part with its own --seed\n";
+      return 1;
+    }
+    seeds.push_back(buffer->Seed());
+    if (merged.Empty()) {
+      merged = std::move(*buffer);
+    } else if (!merged.Merge(*buffer)) {
+      std::cerr << "Checkpoint " << path << " does not match the image size\n";
+      return 1;
+    }
+  }
+  if (!options.checkpoint_path.empty() && !merged.Save(options.checkpoint_path)) {
+    std::cerr << "Failed to write checkpoint " << options.checkpoint_path << "\n";
+    return 1;
+  }
+  merged.WriteImage(std::cout);
+  return 0;
+}
+
+auto OpenPagedScene(const Options& options) -> std::shared_ptr<PagedScene> {
+  // Traces the generated scene from a paged scene file, so that only the pages the render visits
+  // take up memory. The file is reused if it already holds this scene; otherwise it is written
+  // first, out of core, so that the scene never has to fit in memory at all.
+  const SceneParameters& parameters = options.generator;
+  const std::string& path = options.paged_scene_path;
+  const uint64_t key = GeneratedSceneKey(parameters);
+  const size_t budget_bytes = options.page_budget_mb * size_t{1024} * 1024;
+  auto open = [&]() -> std::shared_ptr<PagedScene> {
+    auto scene = std::make_shared<PagedScene>(GeneratedMaterials(parameters), budget_bytes);
+    if (!scene->Open(path)) {
+      return nullptr;
+    }
+    scene->SetTreeletQueues(options.treelet_queues);
+    return scene;
+  };
+  if (std::filesystem::exists(path)) {
+    if (auto scene = open(); scene != nullptr && scene->Key() == key) {
+      return scene;
+    }
+  }
+  std::clog << "Writing paged scene " << path << '\n';
+  const SphereSource spheres = [&](uint64_t first, std::span<SphereRecord> out) {
+    GeneratedSphereRecords(parameters, first, out);
+  };
+  if (!WritePagedScene(path, parameters.sphere_count + 1, spheres, GeneratedPalette::kGround + 1,
+                       key, budget_bytes)) {
+    return nullptr;
+  }
+  return open();
+}
+
+auto ReportImageError(const std::string& reference_path, int width, int height,
+                      const std::vector<Color>& noisy, const std::vector<Color>* denoised)
+    -> void {
+  // Compares the render with a high-spp reference render of the same size.
+  const auto reference = AccumulationBuffer::Load(reference_path);
+  if (!reference || reference->Width() != width || reference->Height() != height) {
+    std::cerr << "Reference " << reference_path << " is missing or does not match the image\n";
+    return;
+  }
+  const std::vector<Color> reference_image = reference->Image();
+  std::clog << "Noisy:    PSNR " << Psnr(noisy, reference_image) << " dB, SSIM "
+            << Ssim(width, height, noisy, reference_image) << '\n';
+  if (denoised != nullptr) {
+    std::clog << "Denoised: PSNR " << Psnr(*denoised, reference_image) << " dB, SSIM "
+              << Ssim(width, height, *denoised, reference_image) << '\n';
+  }
+}
+
+auto WriteFinalImage(const Options& options, const AccumulationBuffer& accumulation,
+                     std::ostream& out, PerfProfile* perf, const PerfCounters* counters) -> void {
+  // Writes a finished render, denoised if asked for, and reports its error against the reference.
+  const int width = accumulation.Width();
+  const int height = accumulation.Height();
+  const std::vector<Color> noisy = accumulation.Image();
+  std::vector<Color> image = noisy;
+  const bool denoise = options.denoise && accumulation.HasGuides();
+  if (options.denoise && !denoise) {
+    std::cerr << "The render resumed a version 1 checkpoint, which has no variance or feature"
+              << " buffers to guide the denoiser; writing it without denoising\n";
+  }
+  if (denoise) {
+    const ScopedPerfRegion region(perf, "denoise", counters);
+    image = Denoise(width, height, noisy, accumulation.VarianceImage(),
+                    accumulation.FeatureImage(), DenoiseOptions{.thread_count = options.threads});
+  }
+  if (!options.reference_path.empty()) {
+    ReportImageError(options.reference_path, width, height, noisy,
+                     denoise ? &image : nullptr);
+  }
+  const ScopedPerfRegion region(perf, "output", counters);
+  WritePpm(out, width, height, image);
+}
+
+auto ParseCameraUpdate(const std::string& line, std::function<void(Camera&)>& update) -> bool {
+  // Reads one preview command, such as "look-from 13 2 3" or "spp 64".
+  std::istringstream in(line);
+  std::string command;
+  in >> command;
+  if (command == "look-from" || command == "look-at") {
+    double x = 0;
+    double y = 0;
+    double z = 0;
+    in >> x >> y >> z;
+    const Point3 point{x, y, z};
+    if (command == "look-from") {
+      update = [point](Camera& cam) { cam.SetLookFrom(point); };
+    } else {
+      update = [point](Camera& cam) { cam.SetLookAt(point); };
+    }
+  } else if (command == "vfov" || command == "defocus-angle" || command == "focus-dist") {
+    double value = 0;
+    in >> value;
+    if (command == "vfov") {
+      update = [value](Camera& cam) { cam.SetVFov(value); };
+    } else if (command == "defocus-angle") {
+      update = [value](Camera& cam) { cam.SetDefocusAngle(value); };
+    } else {
+      update = [value](Camera& cam) { cam.SetFocusDist(value); };
+    }
+  } else if (command == "width" || command == "spp" || command == "max-depth") {
+    int value = 0;
+    in >> value;
+    if (value <= 0) {
+      return false;
+    }
+    if (command == "width") {
+      update = [value](Camera& cam) { cam.SetImageWidth(value); };
+    } else if (command == "spp") {
+      update = [value](Camera& cam) { cam.SetSamplePerPixel(value); };
+    } else {
+      update = [value](Camera& cam) { cam.SetMaxDepth(value); };
+    }
+  } else {
+    return false;
+  }
+  return !in.fail();
+}
+
+auto ReadViews(const std::string& path, std::vector<View>& views) -> bool {
+  // Reads one view per line: the path its image is written to, then the preview commands that
+  // set up its camera, separated by semicolons, as in "top.ppm look-from 0 20 0; spp 32". Empty
+  // lines and lines starting with '#' are skipped.
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Failed to read views " << path << "\n";
+    return false;
+  }
+  std::string line;
+  for (int line_number = 1; std::getline(in, line); line_number++) {
+    std::istringstream fields(line);
+    View view;
+    if (!(fields >> view.output_path) || view.output_path.starts_with('#')) {
+      continue;
+    }
+    std::string command;
+    while (std::getline(fields, command, ';')) {
+      if (command.find_first_not_of(" \t") == std::string::npos) {
+        continue;
+      }
+      std::function<void(Camera&)> update;
+      if (!ParseCameraUpdate(command, update)) {
+        std::cerr << path << ':' << line_number << ": invalid view command:" << command << "\n";
+        return false;
       }
+      view.updates.push_back(std::move(update));
     }
+    views.push_back(std::move(view));
+  }
+  if (views.empty()) {
+    std::cerr << "No views in " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+auto RunPreview(const Hittable& world, const Camera& cam, const std::string& target) -> int {
+  // Streams coarse-to-fine frames to `target` while reading camera updates from stdin, one per
+  // line. Every update restarts the render; "quit" stops it, and the end of the input lets the
+  // latest render complete.
+  FrameWriter writer(target);
+  if (!writer.Ok()) {
+    return 1;
   }
+  ProgressiveRenderer renderer(world, cam, [&](const PreviewFrame& frame) {
+    writer.Write(frame.width, frame.height, frame.pixels);
+    std::clog << "Frame: " << frame.render_width << 'x' << frame.render_height << ", "
+              << frame.samples << " spp, " << (frame.seconds * 1000) << " ms\n";
+  });
+  std::thread input([&renderer] {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      std::function<void(Camera&)> update;
+      if (line == "quit") {
+        renderer.Stop();
+        return;
+      }
+      if (line.empty()) {
+        continue;
+      }
+      if (ParseCameraUpdate(line, update)) {
+        renderer.Update(update);
+      } else {
+        std::cerr << "Unknown preview command: " << line << "\n";
+      }
+    }
+    renderer.Finish();
+  });
+  renderer.Run();
+  input.join();
+  return 0;
+}
 
-  const auto material1{std::make_shared<Dielectric>(1.5)};
-  world.Add(std::make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+}  // namespace
 
-  const auto material2{std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))};
-  world.Add(std::make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+// TODO: Remove NOLINT
+// NOLINTNEXTLINE(bugprone-exception-escape)
+auto main(int argc, char* argv[]) -> int {
+  Options options;
+  if (!ParseOptions(std::span(argv, argc), options)) {
+    return 1;
+  }
+  if (!options.merge_inputs.empty()) {
+    return MergeCheckpoints(options);
+  }
 
-  const auto material3{std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0)};
-  world.Add(std::make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+  // Counters must be opened before the render threads start to include their work. Every thread
+  // created afterwards inherits them, so they are only opened for a profile.
+  PerfProfile profile;
+  PerfProfile* perf = options.perf_json_path.empty() ? nullptr : &profile;
+  std::optional<PerfCounters> process_counters;
+  if (perf != nullptr) {
+    process_counters.emplace(PerfCounters::Scope::kProcess);
+  }
+  const PerfCounters* counters = process_counters ? &*process_counters : nullptr;
 
-  world = HittableList(std::make_shared<BVHNode>(world));
+  if (options.scene == SceneKind::kTextured && options.texture_paths.empty()) {
+    std::cerr << "The textured scene needs at least one --texture\n";
+    return 1;
+  }
+  if (options.treelet_queues &&
+      (options.scene != SceneKind::kGenerated || options.paged_scene_path.empty())) {
+    std::cerr << "--treelet-queues only applies to the generated scene with a --paged-scene\n";
+    return 1;
+  }
+  std::vector<View> views;
+  if (!options.views_path.empty()) {
+    if (!options.preview_target.empty() || !options.checkpoint_path.empty() ||
+        !options.reference_path.empty() || !options.perf_json_path.empty()) {
+      std::cerr << "--views renders to files; it takes no --preview, --checkpoint, --reference or"
+                   " --perf-json\n";
+      return 1;
+    }
+    if (!ReadViews(options.views_path, views)) {
+      return 1;
+    }
+  }
 
   Camera cam;
   cam.SetAspectRatio(16.0 / 9.0);
-  cam.SetImageWidth(400);
-  cam.SetSamplePerPixel(100);
+  cam.SetImageWidth(options.image_width);
+  cam.SetSamplePerPixel(options.samples_per_pixel);
   cam.SetMaxDepth(50);
 
-  cam.SetVFov(20);
-  cam.SetLookFrom(Point3{13, 2, 3});
-  cam.SetLookAt(Point3{0, 0, 0});
-  cam.SetVUp(Vec3{0, 1, 0});
+  if (options.scene == SceneKind::kIndoor) {
+    cam.SetVFov(60);
+    cam.SetLookFrom(Point3{0, 1.5, 3.8});
+    cam.SetLookAt(Point3{0, 1.2, 0});
+    cam.SetVUp(Vec3{0, 1, 0});
+    cam.SetBackground(Color(0, 0, 0));
+    cam.SetMaxDepth(20);  // No path escapes the room; after 20 bounces little light is left
+  } else if (options.scene == SceneKind::kTextured) {
+    cam.SetVFov(40);
+    cam.SetLookFrom(Point3{0, 3, 8});
+    cam.SetLookAt(Point3{0, 1, -6});
+    cam.SetVUp(Vec3{0, 1, 0});
+  } else if (options.scene == SceneKind::kGenerated) {
+    // Over one corner of the field, looking across it.
+    const double side = GeneratedFieldSide(options.generator.sphere_count);
+    cam.SetVFov(40);
+    cam.SetLookFrom(Point3{0.6 * side, 2 + (0.15 * side), 0.6 * side});
+    cam.SetLookAt(Point3{0, 0, 0});
+    cam.SetVUp(Vec3{0, 1, 0});
+  } else {
+    cam.SetVFov(20);
+    cam.SetLookFrom(Point3{13, 2, 3});
+    cam.SetLookAt(Point3{0, 0, 0});
+    cam.SetVUp(Vec3{0, 1, 0});
 
-  cam.SetDefocusAngle(0.6);
-  cam.SetFocusDist(10.0);
+    cam.SetDefocusAngle(0.6);
+    cam.SetFocusDist(10.0);
+  }
+
+  cam.SetSeed(options.seed);
+  cam.SetThreadCount(options.threads);
+  cam.SetNumaMode(options.numa_mode);
+  // Treelet queues reorder the batches of a wavefront render; per-pixel rendering has none.
+  const bool batch_rays = options.treelet_queues && options.ray_order == RayOrder::kPixel;
+  cam.SetRayOrder(batch_rays ? RayOrder::kWavefront : options.ray_order);
+  cam.SetSampler(options.sampler);
+  cam.SetCheckpointPath(options.checkpoint_path);
+  cam.SetCheckpointInterval(options.checkpoint_interval);
+  cam.SetPerfProfile(perf);
 
-  cam.RenderParallel(world);
+  // Startup runs as a graph of stages, so that the stages that do not depend on each other
+  // (opening textures, building the scene, loading a checkpoint) overlap, and the render starts
+  // the moment its inputs are ready.
+  TaskGraph stages;
+  const auto texture_cache =
+      std::make_shared<TextureCache>(options.texture_cache_mb * size_t{1024} * 1024);
+  std::vector<std::shared_ptr<Texture>> textures;
+  std::vector<TaskGraph::Task> scene_inputs;
+  if (!options.texture_paths.empty()) {
+    scene_inputs.push_back(stages.Add("textures", [&] {
+      for (const auto& path : options.texture_paths) {
+        const int texture = texture_cache->Open(path);
+        if (texture < 0) {
+          return false;
+        }
+        textures.push_back(std::make_shared<ImageTexture>(texture_cache, texture));
+      }
+      return true;
+    }));
+  }
+
+  HittableList world;
+  HittableList lights;
+  std::shared_ptr<PagedScene> paged_scene;
+  std::vector<TaskGraph::Task> render_inputs;
+  render_inputs.push_back(stages.Add(
+      "scene",
+      [&] {
+        const ScopedPerfRegion region(perf, "scene_build", counters);
+        if (options.scene == SceneKind::kIndoor) {
+          world = IndoorScene(lights);
+        } else if (options.scene == SceneKind::kTextured) {
+          world = TexturedScene(textures);
+        } else if (options.scene == SceneKind::kGenerated) {
+          options.generator.seed = options.seed;
+          options.generator.thread_count = options.threads;
+          if (options.paged_scene_path.empty()) {
+            world = GeneratedScene(options.generator);
+          } else {
+            paged_scene = OpenPagedScene(options);
+            if (paged_scene == nullptr) {
+              return false;
+            }
+            world = HittableList(paged_scene);  // The file holds the BVH
+          }
+        } else {
+          world = RandomSpheresScene();
+        }
+        if (options.light_sampling && !lights.Objects().empty()) {
+          cam.SetLights(&lights);
+        }
+        return true;
+      },
+      scene_inputs));
+  if (options.scene != SceneKind::kGenerated || options.paged_scene_path.empty()) {
+    render_inputs.push_back(stages.Add(
+        "bvh",
+        [&] {
+          const ScopedPerfRegion region(perf, "bvh_build", counters);
+          world = HittableList(std::make_shared<BVHNode>(std::move(world), options.threads));
+          return true;
+        },
+        {render_inputs.back()}));
+  }
+  if (options.resume && options.preview_target.empty()) {
+    render_inputs.push_back(stages.Add("checkpoint", [&] {
+      if (!cam.LoadCheckpoint(options.checkpoint_path)) {
+        std::cerr << "No usable checkpoint at " << options.checkpoint_path
+                  << "; starting over.\n";
+      }
+      return true;
+    }));
+  }
+  std::once_flag first_tile;
+  std::vector<Camera> view_cameras;
+  if (options.preview_target.empty()) {
+    cam.SetTileCallback([&](int /*x0*/, int /*y0*/) {
+      std::call_once(first_tile, [&] { stages.Mark("first tile"); });
+    });
+    stages.Add(
+        "render",
+        [&] {
+          const ScopedPerfRegion region(perf, "render", counters);
+          if (views.empty()) {
+            cam.Accumulate(world);
+            return true;
+          }
+          // Each view starts from the scene's camera, which by now has the scene's lights.
+          for (const View& view : views) {
+            Camera& view_camera = view_cameras.emplace_back(cam);
+            for (const auto& update : view.updates) {
+              update(view_camera);
+            }
+          }
+          Camera::AccumulateViews(world, view_cameras, options.threads, options.numa_mode);
+          return true;
+        },
+        render_inputs);
+  }
+  if (!stages.Run()) {
+    return 1;
+  }
+  stages.Report(std::clog);
+
+  if (!options.preview_target.empty()) {
+    return RunPreview(world, cam, options.preview_target);
+  }
+
+  if (!textures.empty()) {
+    texture_cache->Report(std::clog);
+  }
+  if (paged_scene != nullptr) {
+    paged_scene->Report(std::clog);
+  }
+  if (views.empty()) {
+    WriteFinalImage(options, cam.Accumulation(), std::cout, perf, counters);
+  }
+  for (size_t k = 0; k < views.size(); k++) {
+    std::ofstream out(views[k].output_path, std::ios::binary);
+    WriteFinalImage(options, view_cameras[k].Accumulation(), out, perf, counters);
+    if (!out) {
+      std::cerr << "Failed to write " << views[k].output_path << "\n";
+      return 1;
+    }
+  }
+
+  if (perf != nullptr) {
+    std::ofstream out(options.perf_json_path);
+    profile.WriteJson(out, process_counters->Error());
+    if (!out) {
+      std::cerr << "Failed to write " << options.perf_json_path << "\n";
+      return 1;
+    }
+  }
 }
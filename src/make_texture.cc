@@ -0,0 +1,67 @@
+// Converts a PPM image (P3 or P6, as written by the renderer) into the tiled, mip-mapped texture
+// format read by the texture cache.
+//
+// Usage: make_texture INPUT.ppm OUTPUT.rttx [TILE_SIZE]
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "color.hh"
+#include "texture_cache.hh"
+
+namespace {
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+auto ReadPpm(const std::string& path, uint32_t& width, uint32_t& height,
+             std::vector<Color>& pixels) -> bool {
+  // Reads a gamma-encoded PPM into linear colors.
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int max_value = 0;
+  in >> magic >> width >> height >> max_value;
+  if (!in || (magic != "P3" && magic != "P6") || max_value <= 0 || max_value > 255) {
+    return false;
+  }
+  in.get();  // The single whitespace character before binary data
+  pixels.resize(static_cast<size_t>(width) * height);
+  for (auto& pixel : pixels) {
+    for (int channel = 0; channel < 3; channel++) {
+      int value = 0;
+      if (magic == "P3") {
+        in >> value;
+      } else {
+        value = in.get();
+      }
+      const double encoded = static_cast<double>(value) / max_value;
+      pixel[channel] = encoded * encoded;  // Inverse of LinerToGamma
+    }
+  }
+  return static_cast<bool>(in);
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, argc);
+  if (args.size() < 3) {
+    std::cerr << "Usage: " << args[0] << " INPUT.ppm OUTPUT.rttx [TILE_SIZE]\n";
+    return 1;
+  }
+  const auto tile_size = static_cast<uint32_t>(args.size() > 3 ? std::stoul(args[3]) : 64);
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<Color> pixels;
+  if (!ReadPpm(args[1], width, height, pixels)) {
+    std::cerr << "Failed to read " << args[1] << "\n";
+    return 1;
+  }
+  if (!WriteTiledTexture(args[2], width, height, pixels, tile_size)) {
+    std::cerr << "Failed to write " << args[2] << "\n";
+    return 1;
+  }
+}
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <cmath>
+#include <memory>
+
 #include "color.hh"
+#include "common.hh"
 #include "hittable.hh"
+#include "onb.hh"
 #include "ray.hh"
+#include "sampler.hh"
+#include "texture.hh"
 #include "vec3.hh"
 
 class Material {
@@ -14,33 +21,85 @@ class Material {
   auto operator=(const Material&&) -> Material&& = delete;
 
   virtual ~Material() = default;
+  // Picks the direction of the scattered ray with values drawn from `sampler`.
   virtual auto Scatter([[maybe_unused]] const Ray& r_in, [[maybe_unused]] const HitRecord& rec,
-                       [[maybe_unused]] Color& attenuation, [[maybe_unused]] Ray& scattered) const
-      -> bool {
+                       [[maybe_unused]] Color& attenuation, [[maybe_unused]] Ray& scattered,
+                       [[maybe_unused]] Sampler& sampler) const -> bool {
+    return false;
+  }
+
+  // Whether Scatter draws nothing but one Next2D() sample, which it warps to a cosine-weighted
+  // direction about the normal. Wavefront renders then draw those samples for the hits of a whole
+  // bounce first, warp them in one batch, and scatter each hit with ScatterCosine instead.
+  [[nodiscard]] virtual auto ScattersCosineWeighted() const -> bool { return false; }
+
+  // Scatter with its cosine-weighted direction already drawn, about the z axis.
+  virtual auto ScatterCosine([[maybe_unused]] const Ray& r_in,
+                             [[maybe_unused]] const HitRecord& rec,
+                             [[maybe_unused]] const Vec3& local_direction,
+                             [[maybe_unused]] Color& attenuation,
+                             [[maybe_unused]] Ray& scattered) const -> bool {
     return false;
   }
+
+  // Surface reflectance, written to the albedo AOV that guides the denoiser.
+  [[nodiscard]] virtual auto Albedo([[maybe_unused]] const HitRecord& rec) const -> Color {
+    return {1, 1, 1};
+  }
+
+  // Radiance the surface emits towards the ray that hit it.
+  [[nodiscard]] virtual auto Emitted([[maybe_unused]] const HitRecord& rec) const -> Color {
+    return {0, 0, 0};
+  }
+
+  // Whether Scatter draws directions from a density that ScatteringPdf can evaluate. Only such
+  // surfaces sample lights directly; for mirrors, glass and fuzzed metal the light is found by
+  // the scattered ray alone. When true, `attenuation * ScatteringPdf` is the BSDF times cosine.
+  [[nodiscard]] virtual auto HasScatteringPdf() const -> bool { return false; }
+
+  // Solid-angle density with which Scatter picks the direction of `scattered`.
+  [[nodiscard]] virtual auto ScatteringPdf([[maybe_unused]] const Ray& r_in,
+                                           [[maybe_unused]] const HitRecord& rec,
+                                           [[maybe_unused]] const Ray& scattered) const -> double {
+    return 0;
+  }
 };
 
 class Lambertian : public Material {
  public:
-  explicit Lambertian(const Color& albedo) : albedo_(albedo) {}
+  explicit Lambertian(const Color& albedo) : texture_(std::make_shared<SolidColor>(albedo)) {}
+  explicit Lambertian(std::shared_ptr<Texture> texture) : texture_(std::move(texture)) {}
 
-  auto Scatter([[maybe_unused]] const Ray& r_in, const HitRecord& rec, Color& attenuation,
-               Ray& scattered) const -> bool override {
-    auto scatter_direction = rec.Normal() + RandomUnitVector();
+  auto Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered,
+               Sampler& sampler) const -> bool override {
+    return ScatterCosine(r_in, rec, SampleCosineHemisphere(sampler.Next2D()), attenuation,
+                         scattered);
+  }
 
-    // Catch degenerate scatter direction
-    if (scatter_direction.NearZero()) {
-      scatter_direction = rec.Normal();
-    }
+  [[nodiscard]] auto ScattersCosineWeighted() const -> bool override { return true; }
 
-    scattered = Ray(rec.P(), scatter_direction, r_in.Time());
-    attenuation = albedo_;
+  auto ScatterCosine(const Ray& r_in, const HitRecord& rec, const Vec3& local_direction,
+                     Color& attenuation, Ray& scattered) const -> bool override {
+    scattered = Ray(rec.P(), ONB(rec.Normal()).Transform(local_direction), r_in.Time());
+    attenuation = texture_->Value(rec);
     return true;
   }
 
+  [[nodiscard]] auto Albedo(const HitRecord& rec) const -> Color override {
+    return texture_->Value(rec);
+  }
+
+  [[nodiscard]] auto HasScatteringPdf() const -> bool override { return true; }
+
+  [[nodiscard]] auto ScatteringPdf([[maybe_unused]] const Ray& r_in, const HitRecord& rec,
+                                   const Ray& scattered) const -> double override {
+    // Scatter picks cosine-weighted directions.
+    const double cos_theta = Dot(rec.Normal(), UnitVector(scattered.Direction()));
+    return cos_theta < 0 ? 0 : cos_theta / kPi;
+  }
+
  private:
-  Color albedo_;
+  std::shared_ptr<Texture> texture_;
 };
 
 class Metal : public Material {
@@ -48,15 +107,19 @@ class Metal : public Material {
   explicit Metal(const Color& albedo, double fuzz)
       : albedo_(albedo), fuzz_(fuzz < 1 ? fuzz : 1.0) {}
 
-  auto Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) const
-      -> bool override {
+  auto Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered,
+               Sampler& sampler) const -> bool override {
     Vec3 reflected = Reflect(r_in.Direction(), rec.Normal());
-    reflected = UnitVector(reflected) + (fuzz_ * RandomUnitVector());
+    reflected = UnitVector(reflected) + (fuzz_ * SampleUniformSphere(sampler.Next2D()));
     scattered = Ray(rec.P(), reflected, r_in.Time());
     attenuation = albedo_;
     return Dot(scattered.Direction(), rec.Normal()) > 0;
   }
 
+  [[nodiscard]] auto Albedo([[maybe_unused]] const HitRecord& rec) const -> Color override {
+    return albedo_;
+  }
+
  private:
   Color albedo_;
   double fuzz_;
@@ -66,8 +129,8 @@ class Dielectric : public Material {
  public:
   explicit Dielectric(double refraction_index) : refraction_index_(refraction_index) {}
 
-  auto Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered) const
-      -> bool override {
+  auto Scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered,
+               Sampler& sampler) const -> bool override {
     attenuation = Color(1.0, 1.0, 1.0);
     const double ri = rec.FrontFace() ? (1.0 / refraction_index_) : refraction_index_;
 
@@ -78,7 +141,7 @@ class Dielectric : public Material {
     const bool cannot_refract = ri * sin_theta > 1.0;
     Vec3 direction;
 
-    if (cannot_refract || Reflectance(cos_theta, ri) > RandomDouble()) {
+    if (cannot_refract || Reflectance(cos_theta, ri) > sampler.Next1D()) {
       direction = Reflect(unit_direction, rec.Normal());
     } else {
       direction = Refract(unit_direction, rec.Normal(), ri);
@@ -101,3 +164,16 @@ class Dielectric : public Material {
     return r0 + ((1 - r0) * std::pow((1 - cosine), 5));
   }
 };
+
+class DiffuseLight : public Material {
+ public:
+  explicit DiffuseLight(const Color& emit) : emit_(emit) {}
+
+  [[nodiscard]] auto Emitted(const HitRecord& rec) const -> Color override {
+    // Emits from the front (outer) face only.
+    return rec.FrontFace() ? emit_ : Color(0, 0, 0);
+  }
+
+ private:
+  Color emit_;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct NumaNode {
+  int id{};
+  std::vector<int> cpus;  // Logical CPUs attached to this node
+};
+
+inline auto ParseCpuList(const std::string& list) -> std::vector<int> {
+  // Parses the kernel's cpulist format, e.g. "0-3,8-11".
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    const auto dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+inline auto AllowedCpu([[maybe_unused]] int cpu) -> bool {
+  // Whether the process may run on `cpu` (containers and taskset often restrict this).
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return true;
+  }
+  return CPU_ISSET(cpu, &set) != 0;
+#else
+  return true;
+#endif
+}
+
+inline auto DetectNumaTopology() -> std::vector<NumaNode> {
+  // Reads the NUMA layout from sysfs. Machines without it (or without NUMA) are reported as one
+  // node holding every CPU, so callers never need a separate non-NUMA path.
+  std::vector<NumaNode> nodes;
+  const std::filesystem::path root{"/sys/devices/system/node"};
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(root, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (!name.starts_with("node") || name.size() == 4 ||
+        !std::all_of(name.begin() + 4, name.end(), [](char c) { return std::isdigit(c) != 0; })) {
+      continue;
+    }
+    std::ifstream in(entry.path() / "cpulist");
+    std::string list;
+    if (!std::getline(in, list)) {
+      continue;
+    }
+    NumaNode node{.id = std::stoi(name.substr(4)), .cpus = ParseCpuList(list)};
+    std::erase_if(node.cpus, [](int cpu) { return !AllowedCpu(cpu); });
+    if (!node.cpus.empty()) {
+      nodes.push_back(std::move(node));
+    }
+  }
+  if (nodes.empty()) {
+    NumaNode node;
+    const int cpu_count = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+      node.cpus.push_back(cpu);
+    }
+    nodes.push_back(std::move(node));
+  }
+  std::ranges::sort(nodes, {}, &NumaNode::id);
+  return nodes;
+}
+
+inline auto PinCurrentThread([[maybe_unused]] int cpu) -> bool {
+  // Restricts the calling thread to one logical CPU. Returns false where unsupported.
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
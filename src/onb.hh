@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cmath>
+
+#include "vec3.hh"
+
+// Orthonormal basis around a direction, used to turn directions sampled around the +Z axis into
+// world space.
+class ONB {
+ public:
+  explicit ONB(const Vec3& n) : w_(UnitVector(n)) {
+    // Duff et al. 2017, "Building an Orthonormal Basis, Revisited": no branches on near-parallel
+    // helper axes.
+    const double sign = std::copysign(1.0, w_.Z());
+    const double a = -1.0 / (sign + w_.Z());
+    const double b = w_.X() * w_.Y() * a;
+    u_ = Vec3(1.0 + (sign * w_.X() * w_.X() * a), sign * b, -sign * w_.X());
+    v_ = Vec3(b, sign + (w_.Y() * w_.Y() * a), -w_.Y());
+  }
+
+  [[nodiscard]] auto U() const -> const Vec3& { return u_; }
+  [[nodiscard]] auto V() const -> const Vec3& { return v_; }
+  [[nodiscard]] auto W() const -> const Vec3& { return w_; }
+
+  [[nodiscard]] auto Transform(const Vec3& v) const -> Vec3 {
+    // Transform from basis coordinates to world space.
+    return (v[0] * u_) + (v[1] * v_) + (v[2] * w_);
+  }
+
+ private:
+  Vec3 u_;
+  Vec3 v_;
+  Vec3 w_;
+};
@@ -0,0 +1,1035 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "aabb.hh"
+#include "hittable.hh"
+#include "interval.hh"
+#include "material.hh"
+#include "ray.hh"
+#include "sphere.hh"
+#include "vec3.hh"
+
+// A sphere as stored in a paged scene file. The factories mirror the constructors of Sphere and
+// MovingSphere, so that a paged sphere is hit exactly where its in-memory counterpart is.
+struct SphereRecord {
+  std::array<double, 3> center;  // At time 0
+  std::array<double, 3> motion;  // Distance the center moves by time 1
+  double radius;
+  uint32_t material;  // Index into the scene's material palette
+  uint32_t moving;    // 0 for a sphere at rest, whose motion is never read
+
+  static auto AtRest(const Point3& center, double radius, uint32_t material) -> SphereRecord {
+    return {.center = {center.X(), center.Y(), center.Z()},
+            .motion = {0, 0, 0},
+            .radius = std::fmax(0, radius),
+            .material = material,
+            .moving = 0};
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static auto Moving(const Point3& center1, const Point3& center2, double radius,
+                     uint32_t material) -> SphereRecord {
+    const Vec3 motion = center2 - center1;
+    return {.center = {center1.X(), center1.Y(), center1.Z()},
+            .motion = {motion.X(), motion.Y(), motion.Z()},
+            .radius = std::fmax(0, radius),
+            .material = material,
+            .moving = 1};
+  }
+
+  [[nodiscard]] auto Center(double time) const -> Point3 {
+    const Point3 start(center[0], center[1], center[2]);
+    if (moving == 0) {
+      return start;
+    }
+    return start + (time * Vec3(motion[0], motion[1], motion[2]));
+  }
+
+  [[nodiscard]] auto BoundingBox() const -> AABB {
+    const auto r_vec = Vec3(radius, radius, radius);
+    const AABB box1(Center(0) - r_vec, Center(0) + r_vec);
+    if (moving == 0) {
+      return box1;
+    }
+    return {box1, AABB(Center(1) - r_vec, Center(1) + r_vec)};
+  }
+};
+
+// A paged scene file ("RTPS"): the header, padded to one page, then the pages. A page is an array
+// of 64-byte slots, each holding a BVH node or a sphere, and contains one or more treelets:
+// connected parts of the BVH whose nodes and spheres all lie in that page. A node whose child is
+// the root of another treelet points at a portal node in its own page instead, which carries the
+// child's bounds, so a ray only enters (and reads) the child's page if it hits those bounds. The
+// root of the BVH is the first slot of the first page.
+struct PagedSceneHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t page_bytes;
+  uint32_t has_motion;
+  uint64_t page_count;
+  uint64_t sphere_count;
+  uint64_t material_count;  // Materials the spheres refer to
+  uint64_t key;             // Identifies the scene the file holds, for callers that reuse files
+  std::array<double, 6> bounds;
+
+  static constexpr std::array<char, 4> kMagic{'R', 'T', 'P', 'S'};
+  static constexpr uint32_t kVersion = 1;
+};
+
+// A BVH node in a page: its bounds and two child references. A node over a single sphere refers
+// to it twice.
+struct PagedNode {
+  std::array<double, 6> bounds;  // x, y and z intervals
+  std::array<uint64_t, 2> children;
+};
+
+static_assert(sizeof(SphereRecord) == 64 && sizeof(PagedNode) == 64);
+
+// Child references of paged nodes: a node or sphere in the same page, or the root node of a
+// treelet anywhere in the file.
+struct PagedRef {
+  enum Kind : uint8_t { kNode, kSphere, kTreelet };
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static constexpr auto Make(Kind kind, uint64_t page, uint32_t slot) -> uint64_t {
+    return (static_cast<uint64_t>(kind) << 62U) | (page << 32U) | slot;
+  }
+  static constexpr auto KindOf(uint64_t ref) -> Kind { return static_cast<Kind>(ref >> 62U); }
+  static constexpr auto Page(uint64_t ref) -> uint64_t { return (ref >> 32U) & 0x3fffffffU; }
+  static constexpr auto Slot(uint64_t ref) -> uint32_t { return static_cast<uint32_t>(ref); }
+};
+
+constexpr uint32_t kDefaultScenePageBytes = 64 * 1024;
+
+// Fills `out` with the spheres [first, first + out.size()) of a scene, the same ones on every call.
+using SphereSource = std::function<void(uint64_t first, std::span<SphereRecord> out)>;
+
+// Writes paged scene files in bounded memory, whatever the size of the scene. A scene that fits
+// in one bin is built as one BVH, the way BVHNode builds it. A larger one is first split in halves
+// on disk, the way BVHNode splits its top levels, until every part fits in a bin; the bins are
+// then built and written one at a time after the pages of those top levels, whose leaves are
+// portals to the roots of the bins. The scene is read from its source a few times per level, and
+// every sphere is written to and read back from a temporary part file once per level.
+class PagedSceneWriter {
+ public:
+  // Bins hold as many spheres as can be built in `memory_budget` bytes.
+  PagedSceneWriter(std::string path, size_t memory_budget, uint32_t page_bytes)
+      : path_(std::move(path)),
+        page_bytes_(page_bytes),
+        capacity_(page_bytes / kSlotBytes),
+        bin_spheres_(std::max<uint64_t>(memory_budget / kBuildBytesPerSphere, kMinBinSpheres)) {}
+
+  auto Write(uint64_t sphere_count, const SphereSource& source, uint64_t material_count,
+             uint64_t key) -> bool {
+    if (sphere_count == 0 || page_bytes_ < 4096 || page_bytes_ % 4096 != 0) {
+      std::cerr << "Cannot page a scene of " << sphere_count << " spheres into " << page_bytes_
+                << "-byte pages\n";
+      return false;
+    }
+    source_ = &source;
+    // Written to a temporary file that then replaces `path`, so that a process that has the old
+    // file mapped keeps reading it, and an interrupted write leaves no truncated scene behind.
+    const std::string tmp_path = path_ + ".tmp";
+    out_.open(tmp_path, std::ios::binary | std::ios::trunc);
+    const bool written = out_ && WriteScene(sphere_count, material_count, key);
+    out_.close();
+    for (const auto& part_path : part_paths_) {
+      std::remove(part_path.c_str());
+    }
+    if (!written || !out_ || std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+      std::cerr << "Failed to write " << path_ << '\n';
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr uint32_t kSlotBytes = 64;
+  // A bin's records, and the boxes, nodes and layout of its BVH, with some to spare.
+  static constexpr uint64_t kBuildBytesPerSphere = 256;
+  static constexpr uint64_t kMinBinSpheres = 4096;
+  static constexpr uint64_t kChunkSpheres = 65536;  // Read, generated and split at a time
+  static constexpr size_t kBuckets = 1024;          // Of the histograms that find medians
+
+  // A BVH, with children referring to nodes and spheres by their index, or to the root of a BVH
+  // written elsewhere in the file by its treelet reference.
+  struct Node {
+    AABB bbox;
+    std::array<uint64_t, 2> children;
+  };
+
+  struct Builder {
+    std::vector<AABB> boxes;
+    std::vector<uint32_t> order;
+    std::vector<Node> nodes;
+
+    // Same bounds, split axis, sort and split point as BVHNode, so both build the same tree.
+    // NOLINTNEXTLINE(misc-no-recursion)
+    auto Build(size_t start, size_t end) -> uint32_t {
+      AABB bbox = AABB::Empty();
+      for (size_t k = start; k < end; k++) {
+        bbox = AABB(bbox, boxes[order[k]]);
+      }
+      const int axis = bbox.LongestAxis();
+      const auto index = static_cast<uint32_t>(nodes.size());
+      nodes.push_back({.bbox = bbox, .children = {}});
+
+      const size_t span = end - start;
+      if (span == 1) {
+        const uint64_t sphere = PagedRef::Make(PagedRef::kSphere, 0, order[start]);
+        nodes[index].children = {sphere, sphere};
+      } else if (span == 2) {
+        nodes[index].children = {PagedRef::Make(PagedRef::kSphere, 0, order[start]),
+                                 PagedRef::Make(PagedRef::kSphere, 0, order[start + 1])};
+      } else {
+        std::sort(order.begin() + static_cast<int64_t>(start),
+                  order.begin() + static_cast<int64_t>(end), [&](uint32_t a, uint32_t b) {
+                    return boxes[a].AxisInterval(axis).Min() < boxes[b].AxisInterval(axis).Min();
+                  });
+        const size_t mid = start + (span / 2);
+        const uint32_t left = Build(start, mid);
+        const uint32_t right = Build(mid, end);
+        nodes[index].children = {PagedRef::Make(PagedRef::kNode, 0, left),
+                                 PagedRef::Make(PagedRef::kNode, 0, right)};
+      }
+      return index;
+    }
+  };
+
+  struct Treelet {
+    std::vector<uint32_t> nodes;  // Breadth-first, root first
+    uint32_t slots{};
+    uint64_t page{};
+    uint32_t first_slot{};
+  };
+
+  // A BVH cut into treelets and packed into pages, numbered from the first page of the BVH.
+  struct Layout {
+    std::vector<Treelet> treelets;
+    std::vector<uint32_t> treelet_of;
+    std::vector<uint32_t> node_slot;
+    uint64_t page_count{};
+  };
+
+  // Spheres still to be split or built: the whole source, or a part file split off it.
+  struct Part {
+    std::string path;  // Empty for the source
+    uint64_t count{};
+    AABB bounds = AABB::Empty();
+  };
+
+  auto WriteScene(uint64_t sphere_count, uint64_t material_count, uint64_t key) -> bool {
+    Part scene{.path = {}, .count = sphere_count};
+    uint64_t page_count = 0;
+    if (sphere_count <= bin_spheres_) {
+      if (!WriteBin(scene, 0, page_count)) {
+        return false;
+      }
+    } else {
+      if (!ForEachChunk(scene, [&](std::span<const SphereRecord> chunk) {
+            for (const auto& sphere : chunk) {
+              scene.bounds = AABB(scene.bounds, sphere.BoundingBox());
+            }
+          })) {
+        return false;
+      }
+      uint32_t root = 0;
+      if (!Partition(scene, root)) {
+        return false;
+      }
+      const Layout top = Cut(top_);
+      page_count = top.page_count;
+      for (auto& [bin, node] : bins_) {
+        uint64_t bin_pages = 0;
+        if (!WriteBin(bin, page_count, bin_pages)) {
+          return false;
+        }
+        std::remove(bin.path.c_str());
+        const uint64_t bin_root = PagedRef::Make(PagedRef::kTreelet, page_count, 0);
+        top_[node].children = {bin_root, bin_root};
+        page_count += bin_pages;
+      }
+      WritePages(top_, top, {}, 0);
+    }
+
+    const PagedSceneHeader header{.magic = PagedSceneHeader::kMagic,
+                                  .version = PagedSceneHeader::kVersion,
+                                  .page_bytes = page_bytes_,
+                                  .has_motion = has_motion_ ? 1U : 0U,
+                                  .page_count = page_count,
+                                  .sphere_count = sphere_count,
+                                  .material_count = material_count,
+                                  .key = key,
+                                  .bounds = BoundsOf(scene.bounds)};
+    std::vector<std::byte> buffer(page_bytes_);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(buffer.data()), page_bytes_);  // NOLINT
+    return static_cast<bool>(out_);
+  }
+
+  // Splits `part` in halves on disk until every part fits in a bin, adding the nodes above the
+  // bins to top_; `index` is that of the node over `part`.
+  // NOLINTNEXTLINE(misc-no-recursion)
+  auto Partition(const Part& part, uint32_t& index) -> bool {
+    index = static_cast<uint32_t>(top_.size());
+    top_.push_back({.bbox = part.bounds, .children = {}});
+    if (part.count <= bin_spheres_) {
+      // Stands in for the root of the bin until the bin is written.
+      const uint64_t bin =
+          PagedRef::Make(PagedRef::kTreelet, 0, static_cast<uint32_t>(bins_.size()));
+      top_[index].children = {bin, bin};
+      bins_.emplace_back(part, index);
+      return true;
+    }
+    Part left = NewPart();
+    Part right = NewPart();
+    if (!Split(part, left, right)) {
+      return false;
+    }
+    if (!part.path.empty()) {
+      std::remove(part.path.c_str());
+    }
+    uint32_t left_index = 0;
+    uint32_t right_index = 0;
+    if (!Partition(left, left_index) || !Partition(right, right_index)) {
+      return false;
+    }
+    top_[index].children = {PagedRef::Make(PagedRef::kNode, 0, left_index),
+                            PagedRef::Make(PagedRef::kNode, 0, right_index)};
+    return true;
+  }
+
+  // The key BVHNode sorts spheres by along an axis.
+  static auto SortKey(const SphereRecord& sphere, int axis) -> double {
+    return sphere.BoundingBox().AxisInterval(axis).Min();
+  }
+
+  // Splits `part` where BVHNode would: along the longest axis of its bounds, `left` gets the
+  // count / 2 spheres that sort first.
+  auto Split(const Part& part, Part& left, Part& right) -> bool {
+    const int axis = part.bounds.LongestAxis();
+    double median = 0;
+    uint64_t ties_left = 0;
+    if (!FindMedian(part, axis, median, ties_left)) {
+      return false;
+    }
+    std::ofstream left_out(left.path, std::ios::binary | std::ios::trunc);
+    std::ofstream right_out(right.path, std::ios::binary | std::ios::trunc);
+    std::vector<SphereRecord> to_left;
+    std::vector<SphereRecord> to_right;
+    auto append = [](std::ofstream& out, const std::vector<SphereRecord>& spheres) {
+      out.write(reinterpret_cast<const char*>(spheres.data()),  // NOLINT
+                static_cast<std::streamsize>(spheres.size() * sizeof(SphereRecord)));
+    };
+    const bool read = ForEachChunk(part, [&](std::span<const SphereRecord> chunk) {
+      to_left.clear();
+      to_right.clear();
+      for (const auto& sphere : chunk) {
+        const double key = SortKey(sphere, axis);
+        bool goes_left = key < median;
+        if (key == median && ties_left > 0) {
+          goes_left = true;
+          ties_left--;
+        }
+        Part& side = goes_left ? left : right;
+        side.count++;
+        side.bounds = AABB(side.bounds, sphere.BoundingBox());
+        (goes_left ? to_left : to_right).push_back(sphere);
+      }
+      append(left_out, to_left);
+      append(right_out, to_right);
+    });
+    left_out.close();
+    right_out.close();
+    return read && left_out && right_out;
+  }
+
+  // Finds the key of rank count / 2 among the spheres of `part`, and how many of the spheres
+  // with that key rank below it. Histograms narrow down the range of keys it lies in until the
+  // spheres in that range fit in memory, whose keys are then sorted.
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto FindMedian(const Part& part, int axis, double& median, uint64_t& ties_left) -> bool {
+    const uint64_t rank = part.count / 2;
+    uint64_t below = 0;  // Spheres with keys under the range
+    Interval range = part.bounds.AxisInterval(axis);
+    uint64_t in_range = part.count;
+    while (in_range > bin_spheres_ && range.Size() > 0) {
+      std::vector<uint64_t> counts(kBuckets, 0);
+      std::vector<Interval> keys(kBuckets, Interval::Empty());
+      const bool read = ForEachChunk(part, [&](std::span<const SphereRecord> chunk) {
+        for (const auto& sphere : chunk) {
+          const double key = SortKey(sphere, axis);
+          if (range.Contains(key)) {
+            const size_t bucket = std::min(
+                static_cast<size_t>((key - range.Min()) / range.Size() * kBuckets), kBuckets - 1);
+            counts[bucket]++;
+            keys[bucket] = Interval(keys[bucket], Interval(key, key));
+          }
+        }
+      });
+      if (!read) {
+        return false;
+      }
+      size_t bucket = 0;
+      for (; below + counts[bucket] <= rank; bucket++) {
+        below += counts[bucket];
+      }
+      // Buckets only ever grow with the key, so exactly this bucket's keys lie in its range.
+      range = keys[bucket];
+      in_range = counts[bucket];
+    }
+    if (range.Size() == 0) {
+      median = range.Min();
+      ties_left = rank - below;
+      return true;
+    }
+    std::vector<double> keys;
+    keys.reserve(in_range);
+    const bool read = ForEachChunk(part, [&](std::span<const SphereRecord> chunk) {
+      for (const auto& sphere : chunk) {
+        if (const double key = SortKey(sphere, axis); range.Contains(key)) {
+          keys.push_back(key);
+        }
+      }
+    });
+    if (!read) {
+      return false;
+    }
+    const auto nth = keys.begin() + static_cast<int64_t>(rank - below);
+    std::ranges::nth_element(keys, nth);
+    median = *nth;
+    ties_left = (rank - below) - static_cast<uint64_t>(std::count_if(
+                                     keys.begin(), nth, [&](double key) { return key < median; }));
+    return true;
+  }
+
+  // Builds the BVH over the spheres of `part` and writes it from `first_page` on.
+  auto WriteBin(Part& part, uint64_t first_page, uint64_t& page_count) -> bool {
+    std::vector<SphereRecord> spheres;
+    spheres.reserve(part.count);
+    const bool read = ForEachChunk(part, [&](std::span<const SphereRecord> chunk) {
+      spheres.insert(spheres.end(), chunk.begin(), chunk.end());
+    });
+    if (!read) {
+      return false;
+    }
+    has_motion_ = has_motion_ || std::ranges::any_of(spheres, [](const SphereRecord& sphere) {
+                    return sphere.moving != 0;
+                  });
+
+    Builder builder;
+    builder.boxes.reserve(spheres.size());
+    for (const auto& sphere : spheres) {
+      builder.boxes.push_back(sphere.BoundingBox());
+    }
+    builder.order.resize(spheres.size());
+    std::iota(builder.order.begin(), builder.order.end(), 0);
+    builder.nodes.reserve(spheres.size());
+    builder.Build(0, spheres.size());
+    builder.boxes = {};
+    builder.order = {};
+    part.bounds = builder.nodes[0].bbox;
+
+    const Layout layout = Cut(builder.nodes);
+    WritePages(builder.nodes, layout, spheres, first_page);
+    page_count = layout.page_count;
+    return static_cast<bool>(out_);
+  }
+
+  static auto DistinctChildren(const Node& node) -> uint32_t {
+    return node.children[0] == node.children[1] ? 1 : 2;
+  }
+
+  // Slots the children of a node take in its treelet: one for each sphere, and one for each node,
+  // which either joins the treelet or is replaced by a portal. A BVH elsewhere in the file is
+  // referred to from the node itself.
+  static auto ChildSlots(const Node& node) -> uint32_t {
+    uint32_t slots = 0;
+    for (uint32_t k = 0; k < DistinctChildren(node); k++) {
+      slots += PagedRef::KindOf(node.children[k]) == PagedRef::kTreelet ? 0 : 1;
+    }
+    return slots;
+  }
+
+  // Cuts the BVH into treelets top-down: each grows breadth-first from its root while its nodes,
+  // their spheres and the portals to the treelets below still fit in a page. The treelets are
+  // then packed into pages in the order they were cut, so that neighbors share pages.
+  [[nodiscard]] auto Cut(const std::vector<Node>& nodes) const -> Layout {
+    constexpr uint32_t kNone = UINT32_MAX;
+    Layout layout{.treelets = {},
+                  .treelet_of = std::vector<uint32_t>(nodes.size(), kNone),
+                  .node_slot = std::vector<uint32_t>(nodes.size()),
+                  .page_count = 0};
+    std::vector<Treelet>& treelets = layout.treelets;
+    std::vector<uint32_t>& treelet_of = layout.treelet_of;
+    std::deque<uint32_t> roots{0};
+    while (!roots.empty()) {
+      const uint32_t root = roots.front();
+      roots.pop_front();
+      const auto id = static_cast<uint32_t>(treelets.size());
+      Treelet treelet{.nodes = {}, .slots = 1};
+      std::deque<uint32_t> frontier;
+      auto take = [&](uint32_t node) {
+        treelet.slots += ChildSlots(nodes[node]);
+        treelet.nodes.push_back(node);
+        treelet_of[node] = id;
+        for (uint32_t k = 0; k < DistinctChildren(nodes[node]); k++) {
+          if (PagedRef::KindOf(nodes[node].children[k]) == PagedRef::kNode) {
+            frontier.push_back(PagedRef::Slot(nodes[node].children[k]));
+          }
+        }
+      };
+      take(root);
+      // A frontier node already has a slot, as a portal; taking it in adds its children's.
+      while (!frontier.empty()) {
+        const uint32_t node = frontier.front();
+        if (treelet.slots + ChildSlots(nodes[node]) > capacity_) {
+          break;
+        }
+        frontier.pop_front();
+        take(node);
+      }
+      // Nodes over BVHs elsewhere in the file need no more room than their portals would, so
+      // they always join instead of becoming treelets of their own.
+      for (const uint32_t node : frontier) {
+        if (ChildSlots(nodes[node]) == 0) {
+          take(node);
+        } else {
+          roots.push_back(node);
+        }
+      }
+      treelets.push_back(std::move(treelet));
+    }
+
+    uint64_t page = 0;
+    uint32_t used = 0;
+    for (auto& treelet : treelets) {
+      if (used + treelet.slots > capacity_) {
+        page++;
+        used = 0;
+      }
+      treelet.page = page;
+      treelet.first_slot = used;
+      for (size_t k = 0; k < treelet.nodes.size(); k++) {
+        layout.node_slot[treelet.nodes[k]] = used + static_cast<uint32_t>(k);
+      }
+      used += treelet.slots;
+    }
+    layout.page_count = page + 1;
+    return layout;
+  }
+
+  // Writes the pages of a BVH laid out by Cut(), from `first_page` of the file on.
+  auto WritePages(const std::vector<Node>& nodes, const Layout& layout,
+                  std::span<const SphereRecord> spheres, uint64_t first_page) -> void {
+    const std::vector<Treelet>& treelets = layout.treelets;
+    std::vector<std::byte> buffer(page_bytes_);
+    auto put = [&](uint32_t slot, const auto& entry) {
+      std::memcpy(buffer.data() + (static_cast<size_t>(slot) * kSlotBytes), &entry, sizeof(entry));
+    };
+    out_.seekp(static_cast<std::streamoff>((first_page + 1) * page_bytes_));
+    size_t next_treelet = 0;
+    for (uint64_t p = 0; p < layout.page_count; p++) {
+      std::ranges::fill(buffer, std::byte{0});
+      for (; next_treelet < treelets.size() && treelets[next_treelet].page == p; next_treelet++) {
+        const Treelet& treelet = treelets[next_treelet];
+        // Spheres and portals follow the treelet's nodes.
+        uint32_t cursor = treelet.first_slot + static_cast<uint32_t>(treelet.nodes.size());
+        for (const uint32_t node : treelet.nodes) {
+          PagedNode paged{.bounds = BoundsOf(nodes[node].bbox), .children = {}};
+          for (uint32_t k = 0; k < DistinctChildren(nodes[node]); k++) {
+            const uint64_t child = nodes[node].children[k];
+            const uint32_t index = PagedRef::Slot(child);
+            if (PagedRef::KindOf(child) == PagedRef::kSphere) {
+              put(cursor, spheres[index]);
+              paged.children[k] = PagedRef::Make(PagedRef::kSphere, 0, cursor++);
+            } else if (PagedRef::KindOf(child) == PagedRef::kTreelet) {
+              paged.children[k] = child;
+            } else if (layout.treelet_of[index] == next_treelet) {
+              paged.children[k] = PagedRef::Make(PagedRef::kNode, 0, layout.node_slot[index]);
+            } else {
+              const uint64_t target =
+                  PagedRef::Make(PagedRef::kTreelet,
+                                 first_page + treelets[layout.treelet_of[index]].page,
+                                 layout.node_slot[index]);
+              put(cursor, PagedNode{.bounds = BoundsOf(nodes[index].bbox),
+                                    .children = {target, target}});
+              paged.children[k] = PagedRef::Make(PagedRef::kNode, 0, cursor++);
+            }
+          }
+          if (DistinctChildren(nodes[node]) == 1) {
+            paged.children[1] = paged.children[0];
+          }
+          put(layout.node_slot[node], paged);
+        }
+      }
+      out_.write(reinterpret_cast<const char*>(buffer.data()), page_bytes_);  // NOLINT
+    }
+  }
+
+  // Calls `visit` with the spheres of `part`, a chunk at a time.
+  template <typename Visit>
+  auto ForEachChunk(const Part& part, const Visit& visit) const -> bool {
+    std::ifstream in;
+    if (!part.path.empty()) {
+      in.open(part.path, std::ios::binary);
+    }
+    std::vector<SphereRecord> chunk;
+    for (uint64_t first = 0; first < part.count; first += kChunkSpheres) {
+      chunk.resize(std::min(kChunkSpheres, part.count - first));
+      if (part.path.empty()) {
+        (*source_)(first, chunk);
+      } else if (!in.read(reinterpret_cast<char*>(chunk.data()),  // NOLINT
+                          static_cast<std::streamsize>(chunk.size() * sizeof(SphereRecord)))) {
+        return false;
+      }
+      visit(std::span<const SphereRecord>(chunk));
+    }
+    return true;
+  }
+
+  auto NewPart() -> Part {
+    part_paths_.push_back(path_ + ".part" + std::to_string(part_paths_.size()));
+    return {.path = part_paths_.back(), .count = 0, .bounds = AABB::Empty()};
+  }
+
+  static auto BoundsOf(const AABB& box) -> std::array<double, 6> {
+    return {box.X().Min(), box.X().Max(), box.Y().Min(),
+            box.Y().Max(), box.Z().Min(), box.Z().Max()};
+  }
+
+  std::string path_;
+  uint32_t page_bytes_;
+  uint32_t capacity_;     // Slots per page
+  uint64_t bin_spheres_;  // Most spheres built as one BVH
+  const SphereSource* source_{};
+  std::ofstream out_;
+  bool has_motion_{false};
+  std::vector<Node> top_;                         // The BVH above the bins
+  std::vector<std::pair<Part, uint32_t>> bins_;   // With the node of top_ over each
+  std::vector<std::string> part_paths_;           // Every part file, to remove at the end
+};
+
+// Writes the `sphere_count` spheres of `source` to a paged scene file at `path`, building no more
+// of its BVH at a time than fits in about `memory_budget` bytes; rendering from the file then
+// needs none of it. `page_bytes` must be a multiple of 4096.
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto WritePagedScene(const std::string& path, uint64_t sphere_count,
+                            const SphereSource& source, uint64_t material_count, uint64_t key,
+                            size_t memory_budget, uint32_t page_bytes = kDefaultScenePageBytes)
+    -> bool {
+  return PagedSceneWriter(path, memory_budget, page_bytes)
+      .Write(sphere_count, source, material_count, key);
+}
+
+// A scene traced straight from a memory-mapped paged scene file, so that only the pages rays
+// actually visit take up memory. The scene keeps at most a budget of pages resident: every page
+// a ray enters is marked as used, and when a newly entered page takes the scene over its budget,
+// a clock sweep evicts the pages unused since the sweep last passed, dropping them from both the
+// mapping and the kernel's page cache. Eviction is only bookkeeping as far as correctness goes: a
+// thread still reading an evicted page simply faults it back in.
+//
+// With treelet queues, HitBatch traces a batch of rays one page at a time: every ray waits in the
+// queue of the next treelet it has to visit, and each round traces all rays waiting on a page
+// together while it is resident, instead of each ray walking the pages on its own.
+class PagedScene : public Hittable {
+ public:
+  struct Stats {
+    uint64_t page_ins;  // Pages read in, counting every time an evicted page came back
+    uint64_t evictions;
+    uint64_t resident_pages;
+    uint64_t batches;       // Groups of rays traced through one page by HitBatch
+    uint64_t batched_rays;  // Summed over the batches
+  };
+
+  // `materials` is the palette the spheres' material indices refer to.
+  PagedScene(std::vector<std::shared_ptr<Material>> materials, size_t budget_bytes)
+      : materials_(std::move(materials)), budget_bytes_(budget_bytes) {}
+
+  // Maps the file at `path`, dropping any of it that is still cached so that the render starts
+  // cold and the statistics count every page read.
+  auto Open(const std::string& path) -> bool {
+    auto file = std::make_shared<PageFile>();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    file->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0) {
+      std::cerr << "Cannot open paged scene " << path << ": " << std::strerror(errno) << '\n';
+      return false;
+    }
+    PagedSceneHeader& header = file->header;
+    struct stat status {};
+    if (pread(file->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != PagedSceneHeader::kMagic || header.version != PagedSceneHeader::kVersion ||
+        header.page_bytes < 4096 || header.page_bytes % 4096 != 0 || header.page_count == 0 ||
+        fstat(file->fd, &status) != 0 ||
+        static_cast<uint64_t>(status.st_size) < (header.page_count + 1) * header.page_bytes) {
+      std::cerr << path << " is not a paged scene\n";
+      return false;
+    }
+    if (header.material_count > materials_.size()) {
+      std::cerr << path << " needs " << header.material_count << " materials, not "
+                << materials_.size() << '\n';
+      return false;
+    }
+    file->size = (header.page_count + 1) * header.page_bytes;
+    void* base = mmap(nullptr, file->size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (base == MAP_FAILED) {
+      std::cerr << "Cannot map " << path << ": " << std::strerror(errno) << '\n';
+      return false;
+    }
+    file->base = static_cast<const std::byte*>(base);
+    // Pages are read whole when a ray first enters them; the kernel's read-ahead would only
+    // bring in pages no ray asked for.
+    madvise(base, file->size, MADV_RANDOM);
+    fdatasync(file->fd);  // Pages still waiting to be written back cannot be dropped
+    posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+    file->states = std::vector<std::atomic<uint8_t>>(header.page_count);
+    file->budget_pages = std::max<uint64_t>(budget_bytes_ / header.page_bytes, 1);
+    getrusage(RUSAGE_SELF, &file->usage_at_open);
+    pages_ = std::move(file);
+    return true;
+  }
+
+  // Trace batches one page at a time; off, HitBatch traces each ray on its own.
+  auto SetTreeletQueues(bool queue) -> void { treelet_queues_ = queue; }
+
+  [[nodiscard]] auto Key() const -> uint64_t { return pages_->header.key; }
+  [[nodiscard]] auto FileBytes() const -> uint64_t { return pages_->size; }
+
+  auto Hit(const Ray& r, const Interval& ray_t, HitRecord& rec) const -> bool override {
+    pages_->Touch(0);
+    return HitNode(0, 0, r, ray_t, rec, nullptr);
+  }
+
+  auto HitBatch(std::span<const Ray> rays, const Interval& ray_t, std::span<HitRecord> recs,
+                std::span<uint8_t> hits) const -> void override {
+    if (!treelet_queues_) {
+      Hittable::HitBatch(rays, ray_t, recs, hits);
+      return;
+    }
+    std::vector<double> closest(rays.size(), ray_t.Max());
+    std::vector<std::vector<Deferred>> deferred(rays.size());
+    std::vector<std::pair<uint64_t, uint32_t>> queue;  // Treelet and ray waiting on it
+    std::vector<std::pair<uint64_t, uint32_t>> next;
+    for (size_t k = 0; k < rays.size(); k++) {
+      hits[k] = 0;
+      queue.emplace_back(PagedRef::Make(PagedRef::kTreelet, 0, 0), static_cast<uint32_t>(k));
+    }
+    while (!queue.empty()) {
+      std::ranges::sort(queue);  // Groups the rays by page
+      next.clear();
+      for (size_t begin = 0; begin < queue.size();) {
+        const uint64_t page = PagedRef::Page(queue[begin].first);
+        size_t end = begin;
+        while (end < queue.size() && PagedRef::Page(queue[end].first) == page) {
+          end++;
+        }
+        pages_->Touch(page);
+        pages_->batches.fetch_add(1, std::memory_order_relaxed);
+        pages_->batched_rays.fetch_add(end - begin, std::memory_order_relaxed);
+        for (size_t entry = begin; entry < end; entry++) {
+          const auto [treelet, k] = queue[entry];
+          auto& pending = deferred[k];
+          if (HitNode(page, PagedRef::Slot(treelet), rays[k], Interval(ray_t.Min(), closest[k]),
+                      recs[k], &pending)) {
+            hits[k] = 1;
+            closest[k] = recs[k].T();
+          }
+          // Queue the ray for the next treelet it reached that may still hold a closer hit.
+          while (!pending.empty()) {
+            const Deferred candidate = pending.back();
+            pending.pop_back();
+            if (candidate.t_enter < closest[k]) {
+              next.emplace_back(candidate.treelet, k);
+              break;
+            }
+          }
+        }
+        begin = end;
+      }
+      std::swap(queue, next);
+    }
+  }
+
+  [[nodiscard]] auto Occluded(const Ray& r, const Interval& ray_t) const -> bool override {
+    pages_->Touch(0);
+    return OccludedNode(0, 0, r, ray_t);
+  }
+
+  [[nodiscard]] auto BoundingBox() const -> AABB override {
+    const auto& b = pages_->header.bounds;
+    return {Interval(b[0], b[1]), Interval(b[2], b[3]), Interval(b[4], b[5])};
+  }
+
+  [[nodiscard]] auto HasMotion() const -> bool override { return pages_->header.has_motion != 0; }
+
+  // Replicas share the mapping, and with it the page budget.
+  [[nodiscard]] auto Clone() const -> std::shared_ptr<Hittable> override {
+    return std::make_shared<PagedScene>(*this);
+  }
+
+  [[nodiscard]] auto PagingStats() const -> Stats {
+    const PageFile& file = *pages_;
+    const std::scoped_lock lock(file.mutex);
+    return {.page_ins = file.page_ins,
+            .evictions = file.evictions,
+            .resident_pages = file.resident,
+            .batches = file.batches.load(),
+            .batched_rays = file.batched_rays.load()};
+  }
+
+  auto Report(std::ostream& out) const -> void {
+    // The fault and block counts are the kernel's, for the whole process since Open().
+    const PageFile& file = *pages_;
+    const Stats stats = PagingStats();
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::vector<unsigned char> cached((file.size + 4095) / 4096);
+    uint64_t cached_bytes = 0;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    if (mincore(const_cast<std::byte*>(file.base), file.size, cached.data()) == 0) {
+      cached_bytes = 4096 * static_cast<uint64_t>(std::ranges::count_if(
+                                cached, [](unsigned char page) { return (page & 1U) != 0; }));
+    }
+    constexpr double kMiB = 1024.0 * 1024.0;
+    const auto mib = [&](uint64_t bytes) { return static_cast<double>(bytes) / kMiB; };
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed << std::setprecision(1) << "Paged scene: " << mib(file.size) << " MiB in "
+        << file.header.page_count << " pages, " << stats.page_ins << " page-ins ("
+        << mib(stats.page_ins * file.header.page_bytes) << " MiB), " << stats.evictions
+        << " evictions, " << mib(stats.resident_pages * file.header.page_bytes)
+        << " MiB resident of "
+        << mib(file.budget_pages * file.header.page_bytes) << " MiB budget, "
+        << mib(cached_bytes) << " MiB in the page cache; "
+        << usage.ru_majflt - file.usage_at_open.ru_majflt << " major and "
+        << usage.ru_minflt - file.usage_at_open.ru_minflt << " minor page faults, "
+        << mib(512 * static_cast<uint64_t>(usage.ru_inblock - file.usage_at_open.ru_inblock))
+        << " MiB read from disk";
+    if (stats.batches > 0) {
+      out << "; " << stats.batches << " treelet batches of "
+          << static_cast<double>(stats.batched_rays) / static_cast<double>(stats.batches)
+          << " rays on average";
+    }
+    out << '\n';
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+ private:
+  static constexpr uint8_t kResident = 1;
+  static constexpr uint8_t kReferenced = 2;  // Entered since the clock hand last passed
+
+  // A treelet a ray has reached but not yet entered, and where the ray enters its bounds.
+  struct Deferred {
+    uint64_t treelet;
+    double t_enter;
+  };
+
+  // The mapping and its residency, shared by a scene and its replicas.
+  struct PageFile {
+    PageFile() = default;
+    PageFile(const PageFile&) = delete;
+    PageFile(PageFile&&) = delete;
+    auto operator=(const PageFile&) -> PageFile& = delete;
+    auto operator=(PageFile&&) -> PageFile& = delete;
+
+    ~PageFile() {
+      if (base != nullptr) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        munmap(const_cast<std::byte*>(base), size);
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+
+    [[nodiscard]] auto Page(uint64_t page) const -> const std::byte* {
+      return base + ((page + 1) * header.page_bytes);
+    }
+
+    auto Touch(uint64_t page) -> void {
+      const uint8_t state = states[page].load(std::memory_order_relaxed);
+      if (state == (kResident | kReferenced)) {
+        return;
+      }
+      if ((state & kResident) != 0) {
+        states[page].fetch_or(kReferenced, std::memory_order_relaxed);
+        return;
+      }
+      PageIn(page);
+    }
+
+    auto PageIn(uint64_t page) -> void {
+      const std::scoped_lock lock(mutex);
+      if ((states[page].load(std::memory_order_relaxed) & kResident) != 0) {
+        return;  // Another thread paged it in first
+      }
+      // Read the whole page now rather than fault it in a block at a time.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      madvise(const_cast<std::byte*>(Page(page)), header.page_bytes, MADV_WILLNEED);
+      states[page].store(kResident | kReferenced, std::memory_order_relaxed);
+      resident++;
+      page_ins++;
+      while (resident > budget_pages) {
+        const uint64_t candidate = clock_hand;
+        clock_hand = (clock_hand + 1) % header.page_count;
+        const uint8_t state = states[candidate].load(std::memory_order_relaxed);
+        if (candidate == page || (state & kResident) == 0) {
+          continue;
+        }
+        if ((state & kReferenced) != 0) {
+          states[candidate].fetch_and(kResident, std::memory_order_relaxed);
+          continue;
+        }
+        states[candidate].store(0, std::memory_order_relaxed);
+        resident--;
+        evictions++;
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        madvise(const_cast<std::byte*>(Page(candidate)), header.page_bytes, MADV_DONTNEED);
+        posix_fadvise(fd, static_cast<off_t>((candidate + 1) * header.page_bytes),
+                      header.page_bytes, POSIX_FADV_DONTNEED);
+      }
+    }
+
+    int fd{-1};
+    const std::byte* base{};
+    uint64_t size{};
+    PagedSceneHeader header{};
+    std::vector<std::atomic<uint8_t>> states;  // kResident and kReferenced bits of each page
+    uint64_t budget_pages{};
+    rusage usage_at_open{};
+
+    mutable std::mutex mutex;  // Guards the fields below
+    uint64_t clock_hand{};
+    uint64_t resident{};
+    uint64_t page_ins{};
+    uint64_t evictions{};
+
+    std::atomic<uint64_t> batches{0};  // Pages traced as a batch by HitBatch
+    std::atomic<uint64_t> batched_rays{0};
+  };
+
+  [[nodiscard]] auto Node(uint64_t page, uint32_t slot) const -> const PagedNode& {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return *reinterpret_cast<const PagedNode*>(pages_->Page(page) + (size_t{slot} * 64));
+  }
+
+  [[nodiscard]] auto Sphere(uint64_t page, uint32_t slot) const -> const SphereRecord& {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return *reinterpret_cast<const SphereRecord*>(pages_->Page(page) + (size_t{slot} * 64));
+  }
+
+  static auto Bounds(const PagedNode& node) -> AABB {
+    const auto& b = node.bounds;
+    return {Interval(b[0], b[1]), Interval(b[2], b[3]), Interval(b[4], b[5])};
+  }
+
+  // Traverses like BVHNode::Hit. Treelets in other pages are entered right away, or, given
+  // `deferred`, left for later.
+  // NOLINTNEXTLINE(misc-no-recursion,bugprone-easily-swappable-parameters)
+  auto HitNode(uint64_t page, uint32_t slot, const Ray& r, const Interval& ray_t, HitRecord& rec,
+               std::vector<Deferred>* deferred) const -> bool {
+    const PagedNode& node = Node(page, slot);
+    Interval clipped = ray_t;
+    if (!Bounds(node).Clip(r, clipped)) {
+      return false;
+    }
+    const bool hit_left = HitChild(page, node.children[0], r, ray_t, clipped.Min(), rec, deferred);
+    if (node.children[1] == node.children[0]) {
+      return hit_left;
+    }
+    const bool hit_right =
+        HitChild(page, node.children[1], r, Interval(ray_t.Min(), hit_left ? rec.T() : ray_t.Max()),
+                 clipped.Min(), rec, deferred);
+    return hit_left || hit_right;
+  }
+
+  // NOLINTNEXTLINE(misc-no-recursion,bugprone-easily-swappable-parameters)
+  auto HitChild(uint64_t page, uint64_t child, const Ray& r, const Interval& ray_t,
+                double t_enter, HitRecord& rec, std::vector<Deferred>* deferred) const -> bool {
+    const uint32_t slot = PagedRef::Slot(child);
+    switch (PagedRef::KindOf(child)) {
+      case PagedRef::kNode:
+        return HitNode(page, slot, r, ray_t, rec, deferred);
+      case PagedRef::kSphere: {
+        const SphereRecord& sphere = Sphere(page, slot);
+        return HitSphere(sphere.Center(r.Time()), sphere.radius,
+                         materials_[sphere.material].get(), r, ray_t, rec);
+      }
+      case PagedRef::kTreelet:
+        break;
+    }
+    const uint64_t target = PagedRef::Page(child);
+    if (deferred != nullptr && target != page) {
+      // Only reached through a portal, whose bounds the ray enters at t_enter.
+      deferred->push_back({.treelet = child, .t_enter = t_enter});
+      return false;
+    }
+    pages_->Touch(target);
+    return HitNode(target, slot, r, ray_t, rec, deferred);
+  }
+
+  // NOLINTNEXTLINE(misc-no-recursion)
+  [[nodiscard]] auto OccludedNode(uint64_t page, uint32_t slot, const Ray& r,
+                                  const Interval& ray_t) const -> bool {
+    const PagedNode& node = Node(page, slot);
+    if (!Bounds(node).Hit(r, ray_t)) {
+      return false;
+    }
+    return OccludedChild(page, node.children[0], r, ray_t) ||
+           (node.children[1] != node.children[0] &&
+            OccludedChild(page, node.children[1], r, ray_t));
+  }
+
+  // NOLINTNEXTLINE(misc-no-recursion)
+  [[nodiscard]] auto OccludedChild(uint64_t page, uint64_t child, const Ray& r,
+                                   const Interval& ray_t) const -> bool {
+    const uint32_t slot = PagedRef::Slot(child);
+    switch (PagedRef::KindOf(child)) {
+      case PagedRef::kNode:
+        return OccludedNode(page, slot, r, ray_t);
+      case PagedRef::kSphere: {
+        const SphereRecord& sphere = Sphere(page, slot);
+        return SphereOccludes(sphere.Center(r.Time()), sphere.radius, r, ray_t);
+      }
+      case PagedRef::kTreelet:
+        break;
+    }
+    pages_->Touch(PagedRef::Page(child));
+    return OccludedNode(PagedRef::Page(child), slot, r, ray_t);
+  }
+
+  std::vector<std::shared_ptr<Material>> materials_;
+  size_t budget_bytes_;
+  bool treelet_queues_{false};
+  std::shared_ptr<PageFile> pages_;
+};
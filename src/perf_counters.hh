@@ -0,0 +1,271 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+// Hardware counters collected around profiled regions.
+enum PerfEvent : uint8_t {
+  kCycles,
+  kInstructions,
+  kL1dMisses,
+  kLlcMisses,
+  kBranchMisses,
+  kPerfEventCount,
+};
+
+constexpr std::array<const char*, kPerfEventCount> kPerfEventNames{
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+struct PerfSample {
+  std::array<uint64_t, kPerfEventCount> counts{};
+  std::array<bool, kPerfEventCount> valid{};  // False where the counter could not be opened
+  double seconds{};
+
+  auto operator-(const PerfSample& start) const -> PerfSample {
+    PerfSample delta{*this};
+    for (size_t e = 0; e < kPerfEventCount; e++) {
+      delta.counts[e] -= start.counts[e];
+    }
+    delta.seconds -= start.seconds;
+    return delta;
+  }
+
+  auto operator+=(const PerfSample& other) -> PerfSample& {
+    for (size_t e = 0; e < kPerfEventCount; e++) {
+      counts[e] += other.counts[e];
+      valid[e] = valid[e] && other.valid[e];
+    }
+    seconds += other.seconds;
+    return *this;
+  }
+};
+
+// A set of hardware counters opened with perf_event_open. Counters that the kernel refuses (no
+// PMU in a VM, perf_event_paranoid, seccomp, non-Linux) are reported as invalid, and Read() still
+// returns wall-clock time, so profiling never stops a render.
+class PerfCounters {
+ public:
+  enum class Scope {
+    kThread,   // The calling thread only
+    kProcess,  // The calling thread plus the threads it creates afterwards, once they exit
+  };
+
+  explicit PerfCounters(Scope scope) {
+    fds_.fill(-1);
+#ifdef __linux__
+    constexpr uint64_t kL1dReadMiss = PERF_COUNT_HW_CACHE_L1D |
+                                      (PERF_COUNT_HW_CACHE_OP_READ << 8U) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+    const std::array<std::pair<uint32_t, uint64_t>, kPerfEventCount> events{{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, kL1dReadMiss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+    for (size_t e = 0; e < kPerfEventCount; e++) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[e].first;
+      attr.config = events[e].second;
+      attr.exclude_kernel = 1;  // Allowed at the default perf_event_paranoid level
+      attr.exclude_hv = 1;
+      attr.inherit = (scope == Scope::kProcess) ? 1 : 0;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fds_[e] < 0 && error_.empty()) {
+        error_ = std::strerror(errno);
+      }
+    }
+#else
+    static_cast<void>(scope);
+    error_ = "perf_event_open is only available on Linux";
+#endif
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters(PerfCounters&&) = delete;
+  auto operator=(const PerfCounters&) -> PerfCounters& = delete;
+  auto operator=(PerfCounters&&) -> PerfCounters& = delete;
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (const int fd : fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  // Why some counter could not be opened, or empty if all of them are counting.
+  [[nodiscard]] auto Error() const -> const std::string& { return error_; }
+
+  [[nodiscard]] auto Read() const -> PerfSample {
+    PerfSample sample;
+    sample.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef __linux__
+    for (size_t e = 0; e < kPerfEventCount; e++) {
+      std::array<uint64_t, 3> value{};  // count, time enabled, time running
+      if (fds_[e] < 0 || read(fds_[e], value.data(), sizeof(value)) != sizeof(value)) {
+        continue;
+      }
+      // Scale up counts of multiplexed counters that did not run the whole time.
+      sample.counts[e] = (value[2] > 0 && value[2] < value[1])
+                             ? static_cast<uint64_t>(static_cast<double>(value[0]) *
+                                                     static_cast<double>(value[1]) /
+                                                     static_cast<double>(value[2]))
+                             : value[0];
+      sample.valid[e] = true;
+    }
+#endif
+    return sample;
+  }
+
+  static auto ForThisThread() -> const PerfCounters& {
+    thread_local const PerfCounters kCounters{Scope::kThread};
+    return kCounters;
+  }
+
+ private:
+  std::array<int, kPerfEventCount> fds_{};
+  std::string error_;
+};
+
+// Counter totals of named regions (scene build, BVH build, render, ...) and of individual render
+// tiles, written out as JSON.
+class PerfProfile {
+ public:
+  auto Add(const std::string& region, const PerfSample& sample) -> void {
+    const std::scoped_lock lock(mutex_);
+    auto& [calls, total] = regions_[region];
+    if (calls++ == 0) {
+      total = sample;
+    } else {
+      total += sample;
+    }
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto AddTile(int x, int y, const PerfSample& sample) -> void {
+    Add("tile", sample);
+    const std::scoped_lock lock(mutex_);
+    tiles_.push_back({.x = x, .y = y, .sample = sample});
+  }
+
+  auto WriteJson(std::ostream& out, const std::string& counter_error) const -> void {
+    const std::scoped_lock lock(mutex_);
+    out << "{\n  \"counters_available\": " << (counter_error.empty() ? "true" : "false");
+    if (!counter_error.empty()) {
+      out << ",\n  \"counter_error\": \"" << counter_error << '"';
+    }
+    out << ",\n  \"regions\": {";
+    const char* separator = "\n";
+    for (const auto& [name, region] : regions_) {
+      out << separator << "    \"" << name << "\": {\"calls\": " << region.first << ", ";
+      WriteSample(out, region.second);
+      out << '}';
+      separator = ",\n";
+    }
+    out << "\n  },\n  \"tiles\": [";
+    separator = "\n";
+    for (const auto& tile : tiles_) {
+      out << separator << "    {\"x\": " << tile.x << ", \"y\": " << tile.y << ", ";
+      WriteSample(out, tile.sample);
+      out << '}';
+      separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+ private:
+  struct TileSample {
+    int x;
+    int y;
+    PerfSample sample;
+  };
+
+  static auto WriteSample(std::ostream& out, const PerfSample& sample) -> void {
+    out << "\"seconds\": " << sample.seconds;
+    for (size_t e = 0; e < kPerfEventCount; e++) {
+      out << ", \"" << kPerfEventNames[e] << "\": ";
+      if (sample.valid[e]) {
+        out << sample.counts[e];
+      } else {
+        out << "null";
+      }
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::pair<size_t, PerfSample>> regions_;  // Name -> (calls, totals)
+  std::vector<TileSample> tiles_;
+};
+
+// Adds the counter deltas between construction and destruction to a profile. A null profile
+// makes the region a no-op that opens no counters, so call sites need no checks.
+class ScopedPerfRegion {
+ public:
+  // Measured with `counters`, or with the calling thread's counters when null.
+  ScopedPerfRegion(PerfProfile* profile, std::string name, const PerfCounters* counters = nullptr)
+      : profile_(profile), name_(std::move(name)) {
+    Start(counters);
+  }
+
+  // Per-tile region, measured on the calling render thread.
+  ScopedPerfRegion(PerfProfile* profile, int tile_x, int tile_y)
+      : profile_(profile), tile_x_(tile_x), tile_y_(tile_y) {
+    Start(nullptr);
+  }
+
+  ScopedPerfRegion(const ScopedPerfRegion&) = delete;
+  ScopedPerfRegion(ScopedPerfRegion&&) = delete;
+  auto operator=(const ScopedPerfRegion&) -> ScopedPerfRegion& = delete;
+  auto operator=(ScopedPerfRegion&&) -> ScopedPerfRegion& = delete;
+
+  ~ScopedPerfRegion() {
+    if (profile_ == nullptr) {
+      return;
+    }
+    const PerfSample delta = counters_->Read() - start_;
+    if (name_.empty()) {
+      profile_->AddTile(tile_x_, tile_y_, delta);
+    } else {
+      profile_->Add(name_, delta);
+    }
+  }
+
+ private:
+  auto Start(const PerfCounters* counters) -> void {
+    if (profile_ == nullptr) {
+      return;
+    }
+    counters_ = (counters != nullptr) ? counters : &PerfCounters::ForThisThread();
+    start_ = counters_->Read();
+  }
+
+  PerfProfile* profile_;
+  std::string name_;                // Empty for tile regions
+  const PerfCounters* counters_{};  // Null when the profile is
+  int tile_x_{};
+  int tile_y_{};
+  PerfSample start_;
+};
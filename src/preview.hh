@@ -0,0 +1,260 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "accumulation_buffer.hh"
+#include "camera.hh"
+#include "color.hh"
+#include "hittable.hh"
+
+// Destination of preview frames. A plain path is replaced with every frame by writing a temporary
+// file and renaming it over the path, so a viewer that reloads the file never sees half a frame.
+// "unix:PATH" connects to a Unix stream socket listening at PATH and sends the frames back to back.
+// Frames are binary (P6) PPM images.
+class FrameWriter {
+ public:
+  explicit FrameWriter(std::string target) {
+    constexpr std::string_view kSocketPrefix = "unix:";
+    if (!target.starts_with(kSocketPrefix)) {
+      path_ = std::move(target);
+      return;
+    }
+    const std::string socket_path = target.substr(kSocketPrefix.size());
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+      std::cerr << "Socket path is too long: " << socket_path << '\n';
+      return;
+    }
+    std::memcpy(&address.sun_path[0], socket_path.c_str(), socket_path.size() + 1);
+    socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (socket_ < 0 || connect(socket_, reinterpret_cast<const sockaddr*>(&address),
+                               sizeof(address)) != 0) {
+      std::cerr << "Cannot connect to " << socket_path << ": " << std::strerror(errno) << '\n';
+      if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+      }
+    }
+  }
+
+  FrameWriter(const FrameWriter&) = delete;
+  FrameWriter(FrameWriter&&) = delete;
+  auto operator=(const FrameWriter&) -> FrameWriter& = delete;
+  auto operator=(FrameWriter&&) -> FrameWriter& = delete;
+
+  ~FrameWriter() {
+    if (socket_ >= 0) {
+      close(socket_);
+    }
+  }
+
+  [[nodiscard]] auto Ok() const -> bool { return !path_.empty() || socket_ >= 0; }
+
+  auto Write(int width, int height, const std::vector<Color>& pixels) -> bool {
+    if (socket_ >= 0) {
+      std::ostringstream out;
+      WriteBinaryPpm(out, width, height, pixels);
+      const std::string data = std::move(out).str();
+      for (size_t sent = 0; sent < data.size();) {
+        const ssize_t n = send(socket_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0) {
+          std::cerr << "Failed to send preview frame: " << std::strerror(errno) << '\n';
+          return false;
+        }
+        sent += static_cast<size_t>(n);
+      }
+      return true;
+    }
+
+    const std::string temporary = path_ + ".tmp";
+    {
+      std::ofstream out(temporary);
+      WriteBinaryPpm(out, width, height, pixels);
+      if (!out) {
+        std::cerr << "Failed to write " << temporary << '\n';
+        return false;
+      }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path_, error);
+    if (error) {
+      std::cerr << "Failed to replace " << path_ << ": " << error.message() << '\n';
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::string path_;  // File replaced with every frame; empty when sending to a socket
+  int socket_{-1};    // Connected socket, or -1
+};
+
+struct PreviewFrame {
+  int width, height;                // Size of the camera's image, which frames are scaled to
+  std::vector<Color> pixels;        // Linear colors, row-major
+  int render_width, render_height;  // Resolution the frame was rendered at
+  uint32_t samples;                 // Samples per pixel at that resolution
+  double seconds;                   // Time since the render (re)started
+};
+
+// Renders a camera's view coarse-to-fine for interactive previews: one sample per pixel at a
+// resolution at most 64 pixels wide, doubling it every pass, then the full resolution with the
+// sample count doubling every pass up to the camera's target. Each pass is scaled up to the full
+// image size and handed to the frame callback as soon as it is done. Update() edits the camera
+// from another thread, abandons the passes in flight and starts over from the coarsest one.
+//
+// The sample count grows with every pass, so the stratified sampler, which divides a planned
+// sample count into strata, degrades to jittered samples; the Sobol samplers are unaffected.
+class ProgressiveRenderer {
+ public:
+  using FrameCallback = std::function<void(const PreviewFrame&)>;
+
+  ProgressiveRenderer(const Hittable& world, Camera camera, FrameCallback on_frame)
+      : world_(world), on_frame_(std::move(on_frame)), camera_(std::move(camera)) {
+    camera_.SetCancelFlag(&cancel_);
+    camera_.SetLogProgress(false);
+  }
+
+  // Renders until Stop(), or until Finish() once the latest camera has been fully rendered.
+  auto Run() -> void {
+    std::unique_lock lock(mutex_);
+    while (!stopped_) {
+      const Camera camera = camera_;
+      const uint64_t generation = generation_;
+      cancel_ = false;
+      lock.unlock();
+      Render(camera);
+      lock.lock();
+      cv_.wait(lock, [&] { return stopped_ || finishing_ || generation_ != generation; });
+      if (finishing_ && generation_ == generation) {
+        break;
+      }
+    }
+  }
+
+  // Applies `edit` to the camera and restarts the render with it.
+  auto Update(const std::function<void(Camera&)>& edit) -> void {
+    const std::scoped_lock lock(mutex_);
+    edit(camera_);
+    generation_++;
+    cancel_ = true;
+    cv_.notify_all();
+  }
+
+  // Lets Run() return once the current camera is fully rendered.
+  auto Finish() -> void {
+    const std::scoped_lock lock(mutex_);
+    finishing_ = true;
+    cv_.notify_all();
+  }
+
+  // Abandons the render and lets Run() return.
+  auto Stop() -> void {
+    const std::scoped_lock lock(mutex_);
+    stopped_ = true;
+    cancel_ = true;
+    cv_.notify_all();
+  }
+
+ private:
+  static constexpr int kCoarsestWidth = 64;  // Widest resolution of the first preview pass
+
+  auto Render(const Camera& camera) -> void {
+    const auto start = std::chrono::steady_clock::now();
+    const int width = camera.ImageWidth();
+    const int height = camera.ImageHeight();
+
+    int coarsest_scale = 1;
+    while (width / coarsest_scale > kCoarsestWidth) {
+      coarsest_scale *= 2;
+    }
+    for (int scale = coarsest_scale; scale > 1; scale /= 2) {
+      Camera coarse = camera;
+      coarse.SetImageWidth(std::max(1, width / scale));
+      coarse.SetSamplePerPixel(1);
+      coarse.Accumulate(world_);
+      if (cancel_) {
+        return;
+      }
+      Emit(coarse.Accumulation(), width, height, start);
+    }
+
+    Camera full = camera;
+    const auto target = static_cast<uint32_t>(std::max(1, camera.SamplesPerPixel()));
+    for (uint32_t samples = 1;; samples = std::min(target, 2 * samples)) {
+      full.SetSamplePerPixel(static_cast<int>(samples));
+      full.Accumulate(world_);
+      if (cancel_) {
+        return;
+      }
+      Emit(full.Accumulation(), width, height, start);
+      if (samples == target) {
+        return;
+      }
+    }
+  }
+
+  auto Emit(const AccumulationBuffer& buffer, int width, int height,
+            std::chrono::steady_clock::time_point start) const -> void {
+    // Nearest-neighbor upscaling: the coarse passes are meant to be fast, not pretty.
+    const std::vector<Color> image = buffer.Image();
+    const int render_width = buffer.Width();
+    const int render_height = buffer.Height();
+    PreviewFrame frame{.width = width,
+                       .height = height,
+                       .pixels = std::vector<Color>(static_cast<size_t>(width) * height),
+                       .render_width = render_width,
+                       .render_height = render_height,
+                       .samples = buffer.SamplesDone(),
+                       .seconds = 0};
+    for (int j = 0; j < height; j++) {
+      const int y = j * render_height / height;
+      for (int i = 0; i < width; i++) {
+        const int x = i * render_width / width;
+        frame.pixels[(static_cast<size_t>(j) * width) + i] =
+            image[(static_cast<size_t>(y) * render_width) + x];
+      }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    frame.seconds = elapsed.count();
+    on_frame_(frame);
+  }
+
+  const Hittable& world_;
+  FrameCallback on_frame_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Camera camera_;             // Latest camera, guarded by mutex_
+  uint64_t generation_{0};    // Number of updates so far, guarded by mutex_
+  bool finishing_{false};     // Guarded by mutex_
+  bool stopped_{false};       // Guarded by mutex_
+  std::atomic<bool> cancel_{false};  // Abandons the passes in flight
+};
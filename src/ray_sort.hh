@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "aabb.hh"
+#include "color.hh"
+#include "interval.hh"
+#include "ray.hh"
+#include "sampler.hh"
+#include "vec3.hh"
+
+enum class RayOrder {
+  kPixel,      // Trace each sample's whole path before starting the next one
+  kWavefront,  // Trace one bounce of every path in a tile at a time, in pixel order
+  kSorted,     // As kWavefront, with secondary rays sorted by origin and direction
+};
+
+// A path being traced in wavefront order.
+struct PathState {
+  Ray ray;
+  Color throughput{1, 1, 1};
+  Color radiance{0, 0, 0};  // Light gathered so far
+  double scatter_pdf{0};    // Density of the last scattered direction; 0 after specular bounces
+  double cone_width{0};     // Width of the ray cone at the ray origin, for texture filtering
+  double cone_spread{0};    // Growth of the cone width per unit of distance along the ray
+  int pixel{};              // Index of the pixel within its tile that receives the path's radiance
+  Sampler sampler;          // Where the path is in its sample sequence
+};
+
+inline auto SpreadBits10(uint32_t x) -> uint32_t {
+  // Inserts two zero bits between each of the low 10 bits of x.
+  x &= 0x3ffU;
+  x = (x | (x << 16U)) & 0x30000ffU;
+  x = (x | (x << 8U)) & 0x300f00fU;
+  x = (x | (x << 4U)) & 0x30c30c3U;
+  x = (x | (x << 2U)) & 0x9249249U;
+  return x;
+}
+
+inline auto MortonCode3(const Vec3& p, const AABB& bounds) -> uint32_t {
+  // 30-bit Morton code of p on a 1024^3 grid spanning `bounds`.
+  auto quantize = [](double x, const Interval& axis) {
+    const double extent = axis.Size() > 0 ? axis.Size() : 1.0;
+    return static_cast<uint32_t>(std::clamp((x - axis.Min()) / extent, 0.0, 1.0) * 1023.0);
+  };
+  return (SpreadBits10(quantize(p.X(), bounds.X())) << 2U) |
+         (SpreadBits10(quantize(p.Y(), bounds.Y())) << 1U) |
+         SpreadBits10(quantize(p.Z(), bounds.Z()));
+}
+
+inline auto OctahedralCode(const Vec3& direction, uint32_t bits) -> uint32_t {
+  // Maps a direction onto the octahedron unfolded into a square, quantized to `bits` per axis.
+  // Nearby directions get nearby codes regardless of hemisphere.
+  const double l1 = std::fabs(direction.X()) + std::fabs(direction.Y()) + std::fabs(direction.Z());
+  double u = direction.X() / l1;
+  double v = direction.Y() / l1;
+  if (direction.Z() < 0) {
+    const double fold_u = (1.0 - std::fabs(v)) * (u >= 0 ? 1.0 : -1.0);
+    const double fold_v = (1.0 - std::fabs(u)) * (v >= 0 ? 1.0 : -1.0);
+    u = fold_u;
+    v = fold_v;
+  }
+  const auto cells = static_cast<double>((1U << bits) - 1);
+  const auto qu = static_cast<uint32_t>(std::clamp((u * 0.5) + 0.5, 0.0, 1.0) * cells);
+  const auto qv = static_cast<uint32_t>(std::clamp((v * 0.5) + 0.5, 0.0, 1.0) * cells);
+  return (qu << bits) | qv;
+}
+
+inline auto RaySortKey(const Ray& r, const AABB& origin_bounds) -> uint64_t {
+  // Direction in the high bits, origin in the low bits: rays heading the same way from nearby
+  // points end up adjacent and walk the same BVH nodes one after another.
+  constexpr uint32_t kDirectionBits = 4;
+  const uint64_t direction = OctahedralCode(r.Direction(), kDirectionBits);
+  return (direction << 30U) | MortonCode3(r.Origin(), origin_bounds);
+}
+
+inline auto SortPaths(std::vector<PathState>& paths, std::vector<PathState>& scratch) -> void {
+  // Reorders the paths (not just indices) so that tracing them also walks their state in order.
+  AABB origin_bounds = AABB::Empty();
+  for (const auto& path : paths) {
+    origin_bounds = AABB(origin_bounds, AABB(path.ray.Origin(), path.ray.Origin()));
+  }
+  std::vector<std::pair<uint64_t, uint32_t>> keys(paths.size());
+  for (size_t k = 0; k < paths.size(); k++) {
+    keys[k] = {RaySortKey(paths[k].ray, origin_bounds), static_cast<uint32_t>(k)};
+  }
+  std::ranges::sort(keys);
+  scratch.clear();
+  for (const auto& [key, index] : keys) {
+    scratch.push_back(paths[index]);
+  }
+  std::swap(paths, scratch);
+}
+
+// Rays traced and time spent per bounce depth, summed over all tiles of a render.
+class BounceStats {
+ public:
+  explicit BounceStats(int max_depth) : entries_(static_cast<size_t>(std::max(max_depth, 0))) {}
+
+  auto Record(int depth, size_t rays, std::chrono::nanoseconds elapsed) -> void {
+    const std::scoped_lock lock(mutex_);
+    entries_[depth].rays += rays;
+    entries_[depth].elapsed += elapsed;
+  }
+
+  auto Report(std::ostream& out) const -> void {
+    const std::scoped_lock lock(mutex_);
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    for (size_t depth = 0; depth < entries_.size(); depth++) {
+      const auto& entry = entries_[depth];
+      if (entry.rays == 0) {
+        break;
+      }
+      const double seconds = std::chrono::duration<double>(entry.elapsed).count();
+      out << "Bounce " << depth << ": " << entry.rays << " rays, " << std::fixed
+          << std::setprecision(3) << (seconds > 0 ? entry.rays / seconds / 1e6 : 0.0)
+          << " Mrays/s per thread\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+ private:
+  struct Entry {
+    size_t rays{};
+    std::chrono::nanoseconds elapsed{};
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+};
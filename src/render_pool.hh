@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "hittable.hh"
+#include "numa.hh"
+
+enum class NumaMode {
+  kOff,        // Unpinned workers sharing one scene
+  kPin,        // Workers pinned to cores; tiles handed out by node
+  kReplicate,  // As kPin, plus a copy of the scene in every node's local memory
+};
+
+// Worker threads that render the tiles of a frame. In the NUMA modes each worker is pinned to a
+// core, every node gets a contiguous band of tiles to work through first (so neighboring tiles,
+// which touch the same parts of the scene, stay on one node), and idle workers steal from other
+// nodes' bands only once their own is exhausted.
+class RenderPool {
+ public:
+  RenderPool(const Hittable& world, int thread_count, NumaMode mode) : world_(world) {
+    std::vector<NumaNode> nodes = DetectNumaTopology();
+    if (mode == NumaMode::kOff) {
+      // One logical node, no pinning.
+      NumaNode all;
+      for (const auto& node : nodes) {
+        all.cpus.insert(all.cpus.end(), node.cpus.begin(), node.cpus.end());
+      }
+      nodes = {all};
+    }
+    int total_cpus = 0;
+    for (const auto& node : nodes) {
+      total_cpus += static_cast<int>(node.cpus.size());
+    }
+    if (thread_count <= 0) {
+      thread_count = std::max(total_cpus, 1);
+    }
+    nodes_ = std::move(nodes);
+    stats_.resize(nodes_.size());
+
+    // Spread the workers over the nodes round-robin, so that a thread count below the core count
+    // still uses every socket.
+    std::vector<size_t> used(nodes_.size(), 0);
+    for (int k = 0; k < thread_count; k++) {
+      const size_t node = static_cast<size_t>(k) % nodes_.size();
+      const auto& cpus = nodes_[node].cpus;
+      const bool pin = mode != NumaMode::kOff && !cpus.empty();
+      const int cpu = pin ? cpus[used[node]++ % cpus.size()] : -1;
+      workers_.push_back({.node = node, .cpu = cpu});
+      stats_[node].threads++;
+    }
+
+    if (mode == NumaMode::kReplicate && nodes_.size() > 1) {
+      // Build each replica on a thread pinned to its node: with the kernel's first-touch policy
+      // the copied BVH nodes and primitives are then allocated in that node's memory.
+      replicas_.resize(nodes_.size());
+      for (size_t node = 0; node < nodes_.size(); node++) {
+        std::thread([&, node] {
+          PinCurrentThread(nodes_[node].cpus.front());
+          replicas_[node] = world_.Clone();
+        }).join();
+      }
+    }
+  }
+
+  [[nodiscard]] auto ThreadCount() const -> int { return static_cast<int>(workers_.size()); }
+
+  // Calls `render_tile(tile, world)` once for every tile in [0, tile_count) and waits for all of
+  // them. `world` is the scene replica local to the calling worker.
+  auto Run(size_t tile_count, const std::function<void(size_t, const Hittable&)>& render_tile)
+      -> void {
+    // Give each node a band of tiles proportional to its share of the workers.
+    const size_t node_count = nodes_.size();
+    std::vector<size_t> begin(node_count + 1, 0);
+    for (size_t node = 0; node < node_count; node++) {
+      begin[node + 1] = begin[node] + (tile_count * stats_[node].threads / workers_.size());
+    }
+    begin[node_count] = tile_count;
+    std::vector<std::atomic<size_t>> next(node_count);
+    for (size_t node = 0; node < node_count; node++) {
+      next[node] = begin[node];
+    }
+
+    std::mutex mutex;
+    std::exception_ptr error;
+    auto worker_thread = [&](const Worker& worker) {
+      if (worker.cpu >= 0) {
+        PinCurrentThread(worker.cpu);
+      }
+      const Hittable& world = replicas_.empty() ? world_ : *replicas_[worker.node];
+      const auto start = std::chrono::steady_clock::now();
+      size_t tiles_done = 0;
+      try {
+        for (size_t offset = 0; offset < node_count; offset++) {
+          const size_t node = (worker.node + offset) % node_count;
+          for (size_t tile = next[node]++; tile < begin[node + 1]; tile = next[node]++) {
+            render_tile(tile, world);
+            tiles_done++;
+          }
+        }
+      } catch (...) {
+        const std::scoped_lock lock(mutex);
+        error = std::current_exception();
+      }
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      const std::scoped_lock lock(mutex);
+      stats_[worker.node].tiles += tiles_done;
+      stats_[worker.node].seconds += elapsed.count();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers_.size());
+    for (const auto& worker : workers_) {
+      threads.emplace_back(worker_thread, worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  auto ReportScaling(std::ostream& out) const -> void {
+    // Per-node throughput, to compare how well each socket scales.
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    for (size_t node = 0; node < nodes_.size(); node++) {
+      const auto& stats = stats_[node];
+      const double tiles_per_thread_second =
+          stats.seconds > 0 ? static_cast<double>(stats.tiles) / stats.seconds : 0.0;
+      out << "NUMA node " << nodes_[node].id << ": " << stats.threads << " threads, "
+          << stats.tiles << " tiles, " << std::fixed << std::setprecision(2)
+          << tiles_per_thread_second << " tiles/s per thread"
+          << (replicas_.empty() ? "" : " (local scene replica)") << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+ private:
+  struct Worker {
+    size_t node;  // Index into nodes_
+    int cpu;      // Core the worker is pinned to, or -1
+  };
+
+  struct NodeStats {
+    size_t threads{};
+    size_t tiles{};
+    double seconds{};  // Summed over the node's workers
+  };
+
+  const Hittable& world_;
+  std::vector<NumaNode> nodes_;
+  std::vector<Worker> workers_;
+  std::vector<NodeStats> stats_;
+  std::vector<std::shared_ptr<Hittable>> replicas_;  // One per node; empty when sharing world_
+};
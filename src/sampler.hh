@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "blue_noise.hh"
+#include "common.hh"
+#include "onb.hh"
+#include "vec3.hh"
+
+enum class SamplerKind : uint8_t {
+  kRandom,      // Independent values from the thread's random generator
+  kStratified,  // Correlated multi-jittered strata over the pixel's samples, per dimension pair
+  kSobol,       // Owen-scrambled Sobol points, shuffled independently per dimension pair
+  kBlueNoise,   // One scrambled Sobol sequence for all pixels, offset per pixel by blue noise
+};
+
+struct Sample2D {
+  double u;
+  double v;
+};
+
+// Generator of the values one camera path consumes: dimension `d` of sample `s` of pixel (x, y).
+// Every Next1D() or Next2D() call moves on to the next dimension(s), so the camera, the materials
+// and the light sampling draw from a fixed sequence of dimensions along each path.
+class Sampler {
+ public:
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  Sampler(SamplerKind kind, uint64_t seed, int x, int y, uint32_t sample, uint32_t sample_count)
+      : kind_(kind), seed_(seed), x_(x), y_(y), sample_(sample), sample_count_(sample_count) {}
+
+  auto Next1D() -> double {
+    const uint32_t dimension = dimension_++;
+    switch (kind_) {
+      case SamplerKind::kRandom:
+        return RandomDouble();
+      case SamplerKind::kStratified:
+        return Stratified1D(dimension);
+      case SamplerKind::kSobol:
+        return ToUnit(ScrambledSobol(sample_, 0, DimensionKey(dimension, true)));
+      case SamplerKind::kBlueNoise:
+        return BlueNoiseShift(ToUnit(ScrambledSobol(sample_, 0, DimensionKey(dimension, false))),
+                              dimension);
+    }
+    return RandomDouble();
+  }
+
+  auto Next2D() -> Sample2D {
+    const uint32_t dimension = dimension_;
+    dimension_ += 2;
+    switch (kind_) {
+      case SamplerKind::kRandom:
+        return {.u = RandomDouble(), .v = RandomDouble()};
+      case SamplerKind::kStratified:
+        return Stratified2D(dimension);
+      case SamplerKind::kSobol: {
+        const uint32_t key = DimensionKey(dimension, true);
+        return {.u = ToUnit(ScrambledSobol(sample_, 0, key)),
+                .v = ToUnit(ScrambledSobol(sample_, 1, key))};
+      }
+      case SamplerKind::kBlueNoise: {
+        const uint32_t key = DimensionKey(dimension, false);
+        return {.u = BlueNoiseShift(ToUnit(ScrambledSobol(sample_, 0, key)), dimension),
+                .v = BlueNoiseShift(ToUnit(ScrambledSobol(sample_, 1, key)), dimension + 1)};
+      }
+    }
+    return {.u = RandomDouble(), .v = RandomDouble()};
+  }
+
+  // Moves on past dimensions the path does not use, without computing their values.
+  auto Skip(uint32_t dimensions) -> void { dimension_ += dimensions; }
+
+ private:
+  static constexpr int kSobolBits = 32;
+
+  // Direction numbers of the first two Sobol dimensions: the van der Corput sequence, and the
+  // dimension generated by the primitive polynomial x + 1.
+  static constexpr auto SobolDirections() -> std::array<std::array<uint32_t, kSobolBits>, 2> {
+    std::array<std::array<uint32_t, kSobolBits>, 2> directions{};
+    uint32_t v = 1U << 31U;
+    for (int bit = 0; bit < kSobolBits; bit++) {
+      directions[0][bit] = 1U << (31U - static_cast<uint32_t>(bit));
+      directions[1][bit] = v;
+      v ^= v >> 1U;
+    }
+    return directions;
+  }
+
+  static auto ToUnit(uint32_t x) -> double { return x * 0x1p-32; }
+
+  static auto ReverseBits(uint32_t x) -> uint32_t {
+    x = ((x & 0x55555555U) << 1U) | ((x >> 1U) & 0x55555555U);
+    x = ((x & 0x33333333U) << 2U) | ((x >> 2U) & 0x33333333U);
+    x = ((x & 0x0f0f0f0fU) << 4U) | ((x >> 4U) & 0x0f0f0f0fU);
+    x = ((x & 0x00ff00ffU) << 8U) | ((x >> 8U) & 0x00ff00ffU);
+    return (x << 16U) | (x >> 16U);
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static auto NestedUniformScramble(uint32_t x, uint32_t seed) -> uint32_t {
+    // Owen scrambling as a hash (Burley 2020, "Practical Hash-based Owen Scrambling"): the
+    // Laine-Karras permutation flips each bit depending only on the bits above it.
+    x = ReverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return ReverseBits(x);
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static auto ScrambledSobol(uint32_t index, int dimension, uint32_t seed) -> uint32_t {
+    // Shuffling the index with its own scramble decorrelates the dimension pairs, which all use
+    // the same two Sobol dimensions; scrambling the result randomizes the points.
+    static constexpr auto kDirections = SobolDirections();
+    index = NestedUniformScramble(index, seed);
+    uint32_t x = 0;
+    if (dimension == 0) {
+      x = ReverseBits(index);  // The van der Corput sequence
+    } else {
+      for (int bit = 0; index != 0; bit++, index >>= 1U) {
+        x ^= (index & 1U) != 0 ? kDirections[dimension][bit] : 0;
+      }
+    }
+    return NestedUniformScramble(x, static_cast<uint32_t>(MixBits(seed + 1 + dimension)));
+  }
+
+  [[nodiscard]] auto DimensionKey(uint32_t dimension, bool per_pixel) const -> uint32_t {
+    const uint64_t pixel =
+        per_pixel ? MixBits((static_cast<uint64_t>(y_) << 32U) | static_cast<uint32_t>(x_)) : 0;
+    return static_cast<uint32_t>(MixBits(seed_ ^ pixel ^ MixBits(dimension)));
+  }
+
+  [[nodiscard]] auto BlueNoiseShift(double value, uint32_t dimension) const -> double {
+    // Toroidal shift by the mask value at the pixel; every dimension reads the mask at its own
+    // offset so that the shifts of different dimensions are unrelated.
+    const uint64_t offset = MixBits(seed_ ^ (0x9e3779b97f4a7c15ULL * (dimension + 1)));
+    const double shift = BlueNoiseMask::Get().Value(x_ + static_cast<int>(offset & 63U),
+                                                    y_ + static_cast<int>((offset >> 6U) & 63U));
+    const double shifted = value + shift;
+    return shifted < 1 ? shifted : shifted - 1;
+  }
+
+  [[nodiscard]] auto Jitter(uint32_t key) const -> double {
+    return static_cast<double>(MixBits(key ^ (static_cast<uint64_t>(sample_) << 32U)) >> 11U) *
+           0x1p-53;
+  }
+
+  [[nodiscard]] auto Stratified1D(uint32_t dimension) const -> double {
+    const uint32_t key = DimensionKey(dimension, true);
+    if (sample_ >= sample_count_) {
+      return Jitter(key);  // Beyond the planned sample count there are no strata left
+    }
+    return (Permute(sample_, sample_count_, key) + Jitter(key)) / sample_count_;
+  }
+
+  [[nodiscard]] auto Stratified2D(uint32_t dimension) const -> Sample2D {
+    // Correlated multi-jittered sampling (Kensler 2013): an m x n grid of strata that is also
+    // stratified in each of the two 1D projections.
+    const uint32_t key = DimensionKey(dimension, true);
+    if (sample_ >= sample_count_) {
+      return {.u = Jitter(key), .v = Jitter(key + 1)};
+    }
+    const auto m = std::max(1U, static_cast<uint32_t>(std::sqrt(sample_count_)));
+    const uint32_t n = (sample_count_ + m - 1) / m;
+    const uint32_t s = Permute(sample_, sample_count_, key * 0x51633e2dU);
+    const uint32_t sx = Permute(s % m, m, key * 0x68bc21ebU);
+    const uint32_t sy = Permute(s / m, n, key * 0x02e5be93U);
+    return {.u = ((s % m) + ((sy + Jitter(key * 0x967a889bU)) / n)) / m,
+            .v = ((s / m) + ((sx + Jitter(key * 0x3b3a2c5bU)) / m)) / n};
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  static auto Permute(uint32_t i, uint32_t length, uint32_t key) -> uint32_t {
+    // Element i of a random permutation of [0, length) chosen by key (Kensler 2013). The hash is
+    // a bijection on the next power of two; values past length walk the cycle until they land.
+    uint32_t mask = length - 1;
+    mask |= mask >> 1U;
+    mask |= mask >> 2U;
+    mask |= mask >> 4U;
+    mask |= mask >> 8U;
+    mask |= mask >> 16U;
+    do {
+      i ^= key;
+      i *= 0xe170893dU;
+      i ^= key >> 16U;
+      i ^= (i & mask) >> 4U;
+      i ^= key >> 8U;
+      i *= 0x0929eb3fU;
+      i ^= key >> 23U;
+      i ^= (i & mask) >> 1U;
+      i *= 1U | key >> 27U;
+      i *= 0x6935fa69U;
+      i ^= (i & mask) >> 11U;
+      i *= 0x74dcb303U;
+      i ^= (i & mask) >> 2U;
+      i *= 0x9e501cc3U;
+      i ^= (i & mask) >> 2U;
+      i *= 0xc860a3dfU;
+      i &= mask;
+      i ^= i >> 5U;
+    } while (i >= length);
+    return (i + key) % length;
+  }
+
+  SamplerKind kind_;
+  uint64_t seed_;
+  int x_;
+  int y_;
+  uint32_t sample_;        // Index of the sample within the pixel
+  uint32_t sample_count_;  // Samples planned per pixel, which the stratified kind divides up
+  uint32_t dimension_{};   // Next dimension to hand out
+};
+
+// Warps from the unit square to common distributions, in closed form so that the strata of
+// stratified and low-discrepancy points survive (rejection sampling would discard them). They
+// draw on no branches and no library calls but std::sqrt, so that a mispredicted branch costs no
+// sample.
+
+// Picks `if_true` or `if_false` with bit masks: compilers turn a conditional expression of doubles
+// into a branch, which the random conditions of the warps would mispredict half the time.
+inline auto Select(bool condition, double if_true, double if_false) -> double {
+  const uint64_t mask = -static_cast<uint64_t>(condition);
+  return std::bit_cast<double>((std::bit_cast<uint64_t>(if_true) & mask) |
+                               (std::bit_cast<uint64_t>(if_false) & ~mask));
+}
+
+struct SinCos {
+  double sin;
+  double cos;
+};
+
+// Sine and cosine of x for |x| <= pi/4, from the polynomials of fdlibm's __kernel_sin and
+// __kernel_cos; within a few ulp of std::sin and std::cos.
+inline auto SinCosQuarterPi(double x) -> SinCos {
+  constexpr double kS1 = -1.66666666666666324348e-01;
+  constexpr double kS2 = 8.33333333332248946124e-03;
+  constexpr double kS3 = -1.98412698298579493134e-04;
+  constexpr double kS4 = 2.75573137070700676789e-06;
+  constexpr double kS5 = -2.50507602534068634195e-08;
+  constexpr double kS6 = 1.58969099521155010221e-10;
+  constexpr double kC1 = 4.16666666666666019037e-02;
+  constexpr double kC2 = -1.38888888888741095749e-03;
+  constexpr double kC3 = 2.48015872894767294178e-05;
+  constexpr double kC4 = -2.75573143513906633035e-07;
+  constexpr double kC5 = 2.08757232129817482790e-09;
+  constexpr double kC6 = -1.13596475577881948265e-11;
+  const double z = x * x;
+  const double sin_poly = kS1 + (z * (kS2 + (z * (kS3 + (z * (kS4 + (z * (kS5 + (z * kS6)))))))));
+  const double cos_poly = kC1 + (z * (kC2 + (z * (kC3 + (z * (kC4 + (z * (kC5 + (z * kC6)))))))));
+  return {.sin = x + (x * z * sin_poly), .cos = 1 - ((0.5 * z) - (z * z * cos_poly))};
+}
+
+// Sine and cosine of 2 pi t for t in [0, 1]: the angle is reduced to within pi/4 of the nearest
+// quarter turn, and the quarter turns are added back by swapping and negating.
+inline auto SinCosTurns(double t) -> SinCos {
+  const double quarters = 4 * t;
+  const auto quarter = static_cast<uint32_t>(quarters + 0.5);  // Nearest quarter turn
+  const SinCos r = SinCosQuarterPi((quarters - quarter) * (kPi / 2));
+  const bool odd = (quarter & 1U) != 0;
+  const double sin_sign = 1 - (2.0 * ((quarter >> 1U) & 1U));
+  const double cos_sign = 1 - (2.0 * (((quarter + 1) >> 1U) & 1U));
+  return {.sin = sin_sign * Select(odd, r.cos, r.sin),
+          .cos = cos_sign * Select(odd, r.sin, r.cos)};
+}
+
+inline auto SampleUniformDisk(Sample2D u) -> Vec3 {
+  // Concentric mapping (Shirley and Chiu 1997): squares map to rings, keeping neighbors together.
+  // The larger coordinate is the radius, the ratio of the smaller one to it the angle within
+  // pi/4 of an axis; at the center both are 0.
+  const double a = (2 * u.u) - 1;
+  const double b = (2 * u.v) - 1;
+  const bool horizontal = std::fabs(a) > std::fabs(b);
+  const double r = Select(horizontal, a, b);
+  const double ratio = Select(horizontal, b, a) / Select(r == 0, 1, r);
+  // Near the y axis the angle is pi/2 minus this one, which swaps sine and cosine.
+  const SinCos angle = SinCosQuarterPi((kPi / 4) * ratio);
+  return {r * Select(horizontal, angle.cos, angle.sin),
+          r * Select(horizontal, angle.sin, angle.cos), 0};
+}
+
+inline auto SampleUniformSphere(Sample2D u) -> Vec3 {
+  const double z = 1 - (2 * u.u);
+  const double r = std::sqrt(std::max(0.0, 1 - (z * z)));
+  const SinCos phi = SinCosTurns(u.v);
+  return {r * phi.cos, r * phi.sin, z};
+}
+
+// Cosine-weighted directions about the z axis.
+inline auto SampleCosineHemisphere(Sample2D u) -> Vec3 {
+  // Malley's method: points uniform on the disk, projected up onto the hemisphere.
+  const Vec3 d = SampleUniformDisk(u);
+  const double z = std::sqrt(std::max(0.0, 1 - d.LengthSquared()));
+  return {d.X(), d.Y(), z};
+}
+
+inline auto SampleCosineHemisphere(const Vec3& normal, Sample2D u) -> Vec3 {
+  return ONB(normal).Transform(SampleCosineHemisphere(u));
+}
+
+// Batch forms of the warps, for callers that draw many samples at once. They take the samples'
+// coordinates and return the points' in separate arrays, so that (x[k], y[k], z[k]) is the warp
+// of (u[k], v[k]), and compilers vectorize their loops: they select with conditional expressions,
+// which become blends there, and the square roots they take vectorize since the build does not
+// set errno in math functions. They compute the same values as the single forms.
+
+inline auto SampleUniformDisk(std::span<const double> u, std::span<const double> v,
+                              std::span<double> x, std::span<double> y) -> void {
+  for (size_t k = 0; k < u.size(); k++) {
+    const double a = (2 * u[k]) - 1;
+    const double b = (2 * v[k]) - 1;
+    const bool horizontal = std::fabs(a) > std::fabs(b);
+    const double r = horizontal ? a : b;
+    // At the center the divisor is 1, added rather than selected, which would keep the division
+    // from vectorizing.
+    const double ratio = (horizontal ? b : a) / (r + static_cast<double>(r == 0));
+    const SinCos angle = SinCosQuarterPi((kPi / 4) * ratio);
+    const double cos_phi = horizontal ? angle.cos : angle.sin;
+    const double sin_phi = horizontal ? angle.sin : angle.cos;
+    x[k] = r * cos_phi;
+    y[k] = r * sin_phi;
+  }
+}
+
+// Cosine-weighted directions about the z axis.
+inline auto SampleCosineHemisphere(std::span<const double> u, std::span<const double> v,
+                                   std::span<double> x, std::span<double> y, std::span<double> z)
+    -> void {
+  SampleUniformDisk(u, v, x, y);
+  for (size_t k = 0; k < u.size(); k++) {
+    z[k] = std::sqrt(std::max(0.0, 1 - ((x[k] * x[k]) + (y[k] * y[k]))));
+  }
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "color.hh"
+#include "common.hh"
+#include "hittable.hh"
+#include "hittable_list.hh"
+#include "material.hh"
+#include "paged_scene.hh"
+#include "sphere.hh"
+#include "vec3.hh"
+
+enum class SceneLayout : uint8_t {
+  kUniform,      // One small sphere per unit cell of a square field, like the book's final scene
+  kClustered,    // Clumps of a thousand small spheres scattered over the same field
+  kOverlapping,  // Spheres up to five cells wide, so every point lies in many bounding boxes
+};
+
+struct SceneParameters {
+  size_t sphere_count{1000};
+  uint64_t seed{0};
+  SceneLayout layout{SceneLayout::kUniform};
+  bool moving{false};           // Diffuse spheres move up during the shutter interval
+  bool mixed_materials{false};  // Metal and glass among the diffuse spheres, as in the book
+  int thread_count{0};          // Generator threads; 0 uses every available core
+};
+
+// Random numbers of one generated object: a counter hashed with the object's kind (`stream`) and
+// index, so an object comes out the same whichever thread generates it and in whatever order.
+class ObjectRandom {
+ public:
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  ObjectRandom(uint64_t seed, uint64_t stream, uint64_t index)
+      : state_(MixBits(seed ^ MixBits((stream << 56U) ^ MixBits(index)))) {}
+
+  auto Next() -> double { return static_cast<double>(MixBits(state_++) >> 11U) * 0x1p-53; }
+  auto Next(double min, double max) -> double { return min + ((max - min) * Next()); }
+
+  auto Gaussian() -> double {
+    // Box-Muller; 1 - Next() is never 0.
+    return std::sqrt(-2 * std::log(1 - Next())) * std::cos(2 * kPi * Next());
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// Side of the square field a generated scene covers, centered on the origin: one unit cell per
+// sphere.
+inline auto GeneratedFieldSide(size_t sphere_count) -> double {
+  return std::ceil(std::sqrt(static_cast<double>(std::max<size_t>(sphere_count, 1))));
+}
+
+// One sphere of a generated scene: the arguments of its Sphere or MovingSphere constructor, with
+// its material as an index into GeneratedMaterials().
+struct GeneratedSphere {
+  Point3 center;
+  Point3 center2;  // Where a moving sphere's center is at time 1
+  double radius;
+  uint32_t material;
+  bool moving;
+};
+
+// Where the material palette of a generated scene keeps each kind of material.
+struct GeneratedPalette {
+  static constexpr uint32_t kDiffuseColors = 64;
+  static constexpr uint32_t kMetals = 16;
+  static constexpr uint32_t kGlass = kDiffuseColors + kMetals;
+  static constexpr uint32_t kGround = kGlass + 1;
+};
+
+// The random streams of a generated scene's objects, one per kind.
+enum GeneratorStream : uint8_t { kSphereStream, kPaletteStream, kClusterStream };
+
+// Calls `make(k)` for every k in [0, count), spread over the generator's threads.
+template <typename Make>
+auto GenerateInParallel(const SceneParameters& parameters, size_t count, const Make& make)
+    -> void {
+  const size_t threads = parameters.thread_count > 0
+                             ? static_cast<size_t>(parameters.thread_count)
+                             : std::max(1U, std::thread::hardware_concurrency());
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (size_t k = count * t / threads; k < count * (t + 1) / threads; k++) {
+        make(k);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// The palette of a generated scene: diffuse colors, then metals, glass and the ground. Materials
+// come from this small shared palette, so that memory grows with the spheres and not with their
+// materials.
+inline auto GeneratedMaterials(const SceneParameters& parameters)
+    -> std::vector<std::shared_ptr<Material>> {
+  std::vector<std::shared_ptr<Material>> materials;
+  constexpr uint32_t kDiffuseColors = GeneratedPalette::kDiffuseColors;
+  for (uint32_t k = 0; k < kDiffuseColors; k++) {
+    ObjectRandom random(parameters.seed, kPaletteStream, k);
+    const Color a(random.Next(), random.Next(), random.Next());
+    const Color b(random.Next(), random.Next(), random.Next());
+    materials.push_back(std::make_shared<Lambertian>(a * b));
+  }
+  for (uint32_t k = 0; k < GeneratedPalette::kMetals; k++) {
+    ObjectRandom random(parameters.seed, kPaletteStream, kDiffuseColors + k);
+    const Color albedo(random.Next(0.5, 1), random.Next(0.5, 1), random.Next(0.5, 1));
+    materials.push_back(std::make_shared<Metal>(albedo, random.Next(0, 0.5)));
+  }
+  materials.push_back(std::make_shared<Dielectric>(1.5));
+  materials.push_back(std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5)));
+  return materials;
+}
+
+// Sphere k of a generated scene; k == sphere_count is the ground. Every sphere is derived from
+// the seed and its index alone, which lets the spheres be generated in parallel and makes the
+// scene identical for any thread count.
+inline auto GeneratedSphereAt(const SceneParameters& parameters, size_t k) -> GeneratedSphere {
+  constexpr size_t kClusterSize = 1000;
+  constexpr double kClusterSpread = 2.0;  // Standard deviation of a cluster's sphere positions
+
+  const size_t count = parameters.sphere_count;
+  const double side = GeneratedFieldSide(count);
+  if (k == count) {
+    // The ground stays wide enough to look flat under the whole field.
+    const double ground_radius = std::max(1000.0, 10 * side);
+    const Point3 center(0, -ground_radius, 0);
+    return {.center = center,
+            .center2 = center,
+            .radius = ground_radius,
+            .material = GeneratedPalette::kGround,
+            .moving = false};
+  }
+
+  const auto cells = static_cast<size_t>(side);
+  ObjectRandom random(parameters.seed, kSphereStream, k);
+  Point3 center;
+  double radius = 0.2;
+  if (parameters.layout == SceneLayout::kClustered) {
+    ObjectRandom cluster(parameters.seed, kClusterStream, k / kClusterSize);
+    const double cx = (side * cluster.Next()) - (side / 2);
+    const double cz = (side * cluster.Next()) - (side / 2);
+    center = Point3(cx + (kClusterSpread * random.Gaussian()),
+                    0.2 + std::fabs(kClusterSpread * random.Gaussian()),
+                    cz + (kClusterSpread * random.Gaussian()));
+  } else {
+    const double x = static_cast<double>(k % cells) - (side / 2) + (0.9 * random.Next());
+    const double z = static_cast<double>(k / cells) - (side / 2) + (0.9 * random.Next());
+    if (parameters.layout == SceneLayout::kOverlapping) {
+      radius = random.Next(0.5, 2.5);
+    }
+    center = Point3(x, radius, z);
+  }
+
+  GeneratedSphere sphere{.center = center,
+                         .center2 = center,
+                         .radius = radius,
+                         .material = GeneratedPalette::kGlass,
+                         .moving = false};
+  const double choose_mat = parameters.mixed_materials ? random.Next() : 0;
+  if (choose_mat < 0.8) {
+    sphere.material = static_cast<uint32_t>(random.Next() * GeneratedPalette::kDiffuseColors);
+    if (parameters.moving) {
+      sphere.center2 = center + Vec3(0, random.Next(0, 0.5), 0);
+      sphere.moving = true;
+    }
+  } else if (choose_mat < 0.95) {
+    sphere.material = GeneratedPalette::kDiffuseColors +
+                      static_cast<uint32_t>(random.Next() * GeneratedPalette::kMetals);
+  }
+  return sphere;
+}
+
+// A field of random spheres on a ground sphere, of any size.
+inline auto GeneratedScene(const SceneParameters& parameters) -> HittableList {
+  const std::vector<std::shared_ptr<Material>> materials = GeneratedMaterials(parameters);
+  const size_t count = parameters.sphere_count;
+  std::vector<std::shared_ptr<Hittable>> objects(count + 1);
+  GenerateInParallel(parameters, count + 1, [&](size_t k) {
+    const GeneratedSphere sphere = GeneratedSphereAt(parameters, k);
+    if (sphere.moving) {
+      objects[k] = std::make_shared<MovingSphere>(sphere.center, sphere.center2, sphere.radius,
+                                                  materials[sphere.material]);
+    } else {
+      objects[k] =
+          std::make_shared<Sphere>(sphere.center, sphere.radius, materials[sphere.material]);
+    }
+  });
+  return HittableList(std::move(objects));
+}
+
+// Spheres [first, first + out.size()) of the same scene as records for WritePagedScene, whose
+// material indices refer to GeneratedMaterials().
+inline auto GeneratedSphereRecords(const SceneParameters& parameters, uint64_t first,
+                                   std::span<SphereRecord> out) -> void {
+  GenerateInParallel(parameters, out.size(), [&](size_t k) {
+    const GeneratedSphere sphere = GeneratedSphereAt(parameters, first + k);
+    out[k] =
+        sphere.moving
+            ? SphereRecord::Moving(sphere.center, sphere.center2, sphere.radius, sphere.material)
+            : SphereRecord::AtRest(sphere.center, sphere.radius, sphere.material);
+  });
+}
+
+// Identifies a generated scene: equal for equal parameters, whatever the thread count.
+inline auto GeneratedSceneKey(const SceneParameters& parameters) -> uint64_t {
+  uint64_t key = MixBits(parameters.sphere_count ^ MixBits(parameters.seed));
+  key = MixBits(key ^ static_cast<uint64_t>(parameters.layout));
+  key = MixBits(key ^ (parameters.moving ? 1U : 0U) ^ (parameters.mixed_materials ? 2U : 0U));
+  return key;
+}
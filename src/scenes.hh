@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "common.hh"
+#include "hittable_list.hh"
+#include "material.hh"
+#include "sphere.hh"
+#include "texture.hh"
+#include "vec3.hh"
+
+inline auto RandomSpheresScene() -> HittableList {
+  // The final scene of the first book: a field of small random spheres around three large ones.
+  HittableList world;
+
+  const auto ground_material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+  world.Add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+
+  for (int a = -11; a < 11; a++) {
+    for (int b = -11; b < 11; b++) {
+      auto choose_mat = RandomDouble();
+      const Point3 center(a + (0.9 * RandomDouble()), 0.2, b + (0.9 * RandomDouble()));
+
+      if ((center - Point3(4, 0.2, 0)).Length() > 0.9) {
+        std::shared_ptr<Material> sphere_material;
+
+        if (choose_mat < 0.8) {
+          // diffuse
+          auto albedo = Color::Random() * Color::Random();
+          sphere_material = std::make_shared<Lambertian>(albedo);
+          auto center2 = center + Vec3(0, RandomDouble(0, .5), 0);
+          world.Add(std::make_shared<MovingSphere>(center, center2, 0.2, sphere_material));
+        } else if (choose_mat < 0.95) {
+          // metal
+          auto albedo = Color::Random(0.5, 1);
+          auto fuzz = RandomDouble(0, 0.5);
+          sphere_material = std::make_shared<Metal>(albedo, fuzz);
+          world.Add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+        } else {
+          // glass
+          sphere_material = std::make_shared<Dielectric>(1.5);
+          world.Add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+        }
+      }
+    }
+  }
+
+  const auto material1{std::make_shared<Dielectric>(1.5)};
+  world.Add(std::make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+
+  const auto material2{std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))};
+  world.Add(std::make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+
+  const auto material3{std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0)};
+  world.Add(std::make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+  return world;
+}
+
+inline auto IndoorScene(HittableList& lights) -> HittableList {
+  // A closed room whose walls are the insides of huge spheres, lit only by two small sphere lights
+  // under the ceiling. Paths gather light only by reaching one of them, so this scene shows what
+  // light sampling buys. The lights are also added to `lights`.
+  HittableList world;
+  constexpr double kWall = 1e4;  // Radius of the wall spheres; flat to within 1e-3 in the room
+
+  const auto white = std::make_shared<Lambertian>(Color(0.73, 0.73, 0.73));
+  const auto red = std::make_shared<Lambertian>(Color(0.65, 0.05, 0.05));
+  const auto green = std::make_shared<Lambertian>(Color(0.12, 0.45, 0.15));
+
+  // The room spans x in [-1.5, 1.5], y in [0, 3] and z in [-1.5, 4].
+  world.Add(std::make_shared<Sphere>(Point3(-1.5 - kWall, 1.5, 1.25), kWall, red));
+  world.Add(std::make_shared<Sphere>(Point3(1.5 + kWall, 1.5, 1.25), kWall, green));
+  world.Add(std::make_shared<Sphere>(Point3(0, -kWall, 1.25), kWall, white));
+  world.Add(std::make_shared<Sphere>(Point3(0, 3 + kWall, 1.25), kWall, white));
+  world.Add(std::make_shared<Sphere>(Point3(0, 1.5, -1.5 - kWall), kWall, white));
+  world.Add(std::make_shared<Sphere>(Point3(0, 1.5, 4 + kWall), kWall, white));
+
+  world.Add(std::make_shared<Sphere>(Point3(-0.75, 0.5, -0.5), 0.5,
+                                     std::make_shared<Lambertian>(Color(0.8, 0.6, 0.2))));
+  world.Add(std::make_shared<Sphere>(Point3(0.65, 0.6, -0.2), 0.6,
+                                     std::make_shared<Metal>(Color(0.8, 0.8, 0.85), 0.05)));
+  world.Add(std::make_shared<Sphere>(Point3(0.05, 0.35, 0.8), 0.35,
+                                     std::make_shared<Dielectric>(1.5)));
+
+  const auto ceiling_light = std::make_shared<Sphere>(
+      Point3(0, 2.7, 0.3), 0.15, std::make_shared<DiffuseLight>(Color(25, 24, 22)));
+  const auto corner_light = std::make_shared<Sphere>(
+      Point3(-1.1, 2.3, -1.1), 0.1, std::make_shared<DiffuseLight>(Color(30, 20, 10)));
+  world.Add(ceiling_light);
+  world.Add(corner_light);
+  lights.Add(ceiling_light);
+  lights.Add(corner_light);
+
+  return world;
+}
+
+inline auto TexturedScene(const std::vector<std::shared_ptr<Texture>>& textures) -> HittableList {
+  // Rows of image-textured spheres receding from the camera, so that texture lookups range from
+  // the finest mip levels up close to coarse ones in the distance. The spheres take the textures
+  // in turn.
+  HittableList world;
+  world.Add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000,
+                                     std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+  size_t next = 0;
+  for (int row = 0; row < 8; row++) {
+    for (int column = -3; column <= 3; column++) {
+      const auto material = std::make_shared<Lambertian>(textures[next++ % textures.size()]);
+      world.Add(std::make_shared<Sphere>(Point3(column * 2.2, 1, row * -3.0), 1.0, material));
+    }
+  }
+  return world;
+}
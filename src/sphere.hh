@@ -1,23 +1,101 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
+#include "common.hh"
 #include "hittable.hh"
+#include "onb.hh"
 #include "ray.hh"
+#include "sampler.hh"
 #include "vec3.hh"
 
-class Sphere : public Hittable {
+// Sets the surface coordinates of a hit at the point p of the unit sphere, on a sphere of the
+// given radius.
+inline auto SetSphereUV(const Vec3& p, double radius, HitRecord& rec) -> void {
+  // p: a given point on the sphere of radius one, centered at the origin.
+  // u: returned value [0,1] of angle around the Y axis from X=-1.
+  // v: returned value [0,1] of angle from Y=-1 to Y=+1.
+  //     <1 0 0> yields <0.50 0.50>       <-1  0  0> yields <0.00 0.50>
+  //     <0 1 0> yields <0.50 1.00>       < 0 -1  0> yields <0.50 0.00>
+  //     <0 0 1> yields <0.25 0.50>       < 0  0 -1> yields <0.75 0.50>
+  const double theta = std::acos(std::clamp(-p.Y(), -1.0, 1.0));
+  const double phi = std::atan2(-p.Z(), p.X()) + kPi;
+  // A unit of u spans the circle of latitude, 2 pi r sin(theta); a unit of v spans half a great
+  // circle, pi r. Near the poles u is squeezed, which only makes the footprint wider there.
+  const double uv_scale = kPi * radius * std::max(std::min(2 * std::sin(theta), 1.0), 1e-6);
+  rec.SetUV(phi / (2 * kPi), theta / kPi, uv_scale);
+}
+
+// The nearest intersection of r with a sphere within ray_t. The sphere classes and the spheres
+// of paged scenes share it, so both produce the same hits.
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto HitSphere(const Point3& center, double radius, const Material* mat, const Ray& r,
+                      const Interval& ray_t, HitRecord& rec) -> bool {
+  const Vec3 oc = center - r.Origin();
+  const double a = r.Direction().LengthSquared();
+  const double h = Dot(r.Direction(), oc);
+  const double c = oc.LengthSquared() - (radius * radius);
+  const double discriminant = (h * h) - (a * c);
+  if (discriminant < 0) {
+    return false;
+  }
+
+  const double sqrt_d = std::sqrt(discriminant);
+  // Find the nearest root that lies in the acceptable range.
+  double root = (h - sqrt_d) / a;
+  if (!ray_t.Surrounds(root)) {
+    root = (h + sqrt_d) / a;
+    if (!ray_t.Surrounds(root)) {
+      return false;
+    }
+  }
+  rec.SetT(root);
+  rec.SetP(r.At(rec.T()));
+  const Vec3 outward_normal = (rec.P() - center) / radius;
+  rec.SetFaceNormal(r, outward_normal);
+  SetSphereUV(outward_normal, radius, rec);
+  rec.SetMaterial(mat);
+  return true;
+}
+
+// Same roots as HitSphere, without filling in a hit record.
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto SphereOccludes(const Point3& center, double radius, const Ray& r,
+                           const Interval& ray_t) -> bool {
+  const Vec3 oc = center - r.Origin();
+  const double a = r.Direction().LengthSquared();
+  const double h = Dot(r.Direction(), oc);
+  const double c = oc.LengthSquared() - (radius * radius);
+  const double discriminant = (h * h) - (a * c);
+  if (discriminant < 0) {
+    return false;
+  }
+  const double sqrt_d = std::sqrt(discriminant);
+  return ray_t.Surrounds((h - sqrt_d) / a) || ray_t.Surrounds((h + sqrt_d) / a);
+}
+
+// A sphere at rest, or one moving linearly from center1 at time 0 to center2 at time 1. The two
+// are separate types so that a sphere at rest neither stores a motion vector nor evaluates it in
+// every intersection test.
+template <bool kMoving>
+class SphereShape : public Hittable {
  public:
   // Stationary Sphere
-  Sphere(const Point3& static_center, const double radius, std::shared_ptr<Material> mat)
-      : center_(static_center, Vec3(0, 0, 0)), radius_(std::fmax(0, radius)), mat_(std::move(mat)) {
+  SphereShape(const Point3& static_center, const double radius, std::shared_ptr<Material> mat)
+    requires(!kMoving)
+      : center_(static_center), radius_(std::fmax(0, radius)), mat_(std::move(mat)) {
     const auto r_vec = Vec3(radius, radius, radius);
     bbox_ = AABB(static_center - r_vec, static_center + r_vec);
   }
 
   // Moving Sphere
-  Sphere(const Point3& center1, const Point3& center2, const double radius,
-         std::shared_ptr<Material> mat)
+  SphereShape(const Point3& center1, const Point3& center2, const double radius,
+              std::shared_ptr<Material> mat)
+    requires(kMoving)
       : center_(center1, center2 - center1), radius_(std::fmax(0, radius)), mat_(std::move(mat)) {
     const auto r_vec = Vec3(radius, radius, radius);
     const AABB box1(center_.At(0) - r_vec, center_.At(0) + r_vec);
@@ -26,38 +104,73 @@ class Sphere : public Hittable {
   }
 
   auto Hit(const Ray& r, const Interval& ray_t, HitRecord& rec) const -> bool override {
-    const Point3 current_center = center_.At(r.Time());
-    const Vec3 oc = current_center - r.Origin();
-    const double a = r.Direction().LengthSquared();
-    const double h = Dot(r.Direction(), oc);
-    const double c = oc.LengthSquared() - (radius_ * radius_);
-    const double discriminant = (h * h) - (a * c);
-    if (discriminant < 0) {
-      return false;
-    }
+    return HitSphere(Center(r.Time()), radius_, mat_.get(), r, ray_t, rec);
+  }
 
-    const double sqrt_d = std::sqrt(discriminant);
-    // Find the nearest root that lies in the acceptable range.
-    double root = (h - sqrt_d) / a;
-    if (!ray_t.Surrounds(root)) {
-      root = (h + sqrt_d) / a;
-      if (!ray_t.Surrounds(root)) {
-        return false;
-      }
-    }
-    rec.SetT(root);
-    rec.SetP(r.At(rec.T()));
-    const Vec3 outward_normal = (rec.P() - current_center) / radius_;
-    rec.SetFaceNormal(r, outward_normal);
-    rec.SetMaterial(mat_);
-    return true;
+  [[nodiscard]] auto Occluded(const Ray& r, const Interval& ray_t) const -> bool override {
+    return SphereOccludes(Center(r.Time()), radius_, r, ray_t);
   }
 
   [[nodiscard]] auto BoundingBox() const -> AABB override { return bbox_; }
 
+  [[nodiscard]] auto HasMotion() const -> bool override { return kMoving; }
+
+  [[nodiscard]] auto Clone() const -> std::shared_ptr<Hittable> override {
+    return std::make_shared<SphereShape>(*this);
+  }
+
+  [[nodiscard]] auto PdfValue(const Ray& r) const -> double override {
+    // Random() samples the cone of directions subtended by the sphere uniformly, or from inside
+    // it the whole sphere of directions.
+    const Vec3 to_center = Center(r.Time()) - r.Origin();
+    const double cos_theta_max = CosThetaMax(to_center);
+    if (cos_theta_max < 0) {
+      return 1 / (4 * kPi);
+    }
+    if (Dot(UnitVector(r.Direction()), UnitVector(to_center)) < cos_theta_max) {
+      return 0;
+    }
+    return 1 / (2 * kPi * (1 - cos_theta_max));
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] auto Random(const Point3& origin, double time, Sampler& sampler) const
+      -> Vec3 override {
+    const Vec3 to_center = Center(time) - origin;
+    const double cos_theta_max = CosThetaMax(to_center);
+    const Sample2D u = sampler.Next2D();
+    if (cos_theta_max < 0) {
+      return SampleUniformSphere(u);  // Inside the sphere: every direction hits it
+    }
+    const double z = 1 + (u.u * (cos_theta_max - 1));
+    const SinCos phi = SinCosTurns(u.v);
+    const double sin_theta = std::sqrt(1 - (z * z));
+    return ONB(to_center).Transform(Vec3(phi.cos * sin_theta, phi.sin * sin_theta, z));
+  }
+
  private:
-  Ray center_;
+  [[nodiscard]] auto Center([[maybe_unused]] double time) const -> Point3 {
+    if constexpr (kMoving) {
+      return center_.At(time);
+    } else {
+      return center_;
+    }
+  }
+
+  [[nodiscard]] auto CosThetaMax(const Vec3& to_center) const -> double {
+    // Cosine of the half angle of the cone the sphere subtends, or -1 from inside the sphere.
+    const double distance_squared = to_center.LengthSquared();
+    const double radius_squared = radius_ * radius_;
+    return distance_squared > radius_squared
+               ? std::sqrt(1 - (radius_squared / distance_squared))
+               : -1.0;
+  }
+
+  std::conditional_t<kMoving, Ray, Point3> center_;  // The path of a moving sphere's center
   double radius_;
   std::shared_ptr<Material> mat_;
   AABB bbox_;
 };
+
+using Sphere = SphereShape<false>;
+using MovingSphere = SphereShape<true>;
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The stages of a job, such as loading a scene, building its BVH and rendering it. Each stage
+// runs on its own thread as soon as the stages it depends on are done, so independent stages
+// overlap. The graph records when every stage ran, and Report() prints the critical path: the
+// chain of stages that ends with the last one to finish, each waiting on its slowest dependency.
+class TaskGraph {
+ public:
+  using Task = size_t;
+
+  // Adds a stage that runs `run` once every stage in `after` is done. A stage that returns false
+  // fails the job, and the stages that depend on it are skipped.
+  auto Add(std::string name, std::function<bool()> run, std::vector<Task> after = {}) -> Task {
+    stages_.push_back({.name = std::move(name), .run = std::move(run), .after = std::move(after)});
+    return stages_.size() - 1;
+  }
+
+  // Runs every stage and waits for all of them. Returns false if a stage failed.
+  auto Run() -> bool {
+    start_ = std::chrono::steady_clock::now();
+    std::exception_ptr error;
+    auto stage_thread = [&](Stage& stage) {
+      {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [&] {
+          return std::all_of(stage.after.begin(), stage.after.end(),
+                             [&](Task task) { return stages_[task].state != State::kPending; });
+        });
+        if (std::any_of(stage.after.begin(), stage.after.end(),
+                        [&](Task task) { return stages_[task].state != State::kDone; })) {
+          stage.state = State::kSkipped;
+          cv_.notify_all();
+          return;
+        }
+      }
+      const double begin = Seconds();
+      bool ok = false;
+      try {
+        ok = stage.run();
+      } catch (...) {
+        const std::scoped_lock lock(mutex_);
+        error = std::current_exception();
+      }
+      const std::scoped_lock lock(mutex_);
+      stage.begin = begin;
+      stage.end = Seconds();
+      stage.state = ok ? State::kDone : State::kFailed;
+      cv_.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(stages_.size());
+    for (auto& stage : stages_) {
+      threads.emplace_back(stage_thread, std::ref(stage));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return std::all_of(stages_.begin(), stages_.end(),
+                       [](const Stage& stage) { return stage.state == State::kDone; });
+  }
+
+  // Records that something happened, such as the first tile being rendered. May be called from
+  // any stage.
+  auto Mark(std::string name) -> void {
+    const double now = Seconds();
+    const std::scoped_lock lock(mutex_);
+    marks_.emplace_back(std::move(name), now);
+  }
+
+  // Prints when each stage ran and each mark happened, in milliseconds since Run(), and the
+  // critical path.
+  auto Report(std::ostream& out) const -> void {
+    const std::scoped_lock lock(mutex_);
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed << std::setprecision(1) << std::setw(12) << "stage" << std::setw(10)
+        << "start ms" << std::setw(10) << "end ms" << std::setw(10) << "ms" << '\n';
+    Task last = stages_.size();
+    for (Task task = 0; task < stages_.size(); task++) {
+      const Stage& stage = stages_[task];
+      out << std::setw(12) << stage.name;
+      if (stage.state == State::kSkipped) {
+        out << "   skipped\n";
+        continue;
+      }
+      out << std::setw(10) << 1000 * stage.begin << std::setw(10) << 1000 * stage.end
+          << std::setw(10) << 1000 * (stage.end - stage.begin) << '\n';
+      if (last == stages_.size() || stage.end > stages_[last].end) {
+        last = task;
+      }
+    }
+    for (const auto& [name, seconds] : marks_) {
+      out << std::setw(12) << name << std::setw(10) << 1000 * seconds << '\n';
+    }
+
+    std::vector<Task> path;
+    for (Task task = last; task < stages_.size();) {
+      path.push_back(task);
+      const std::vector<Task>& after = stages_[task].after;
+      const auto slowest = std::max_element(after.begin(), after.end(), [&](Task a, Task b) {
+        return stages_[a].end < stages_[b].end;
+      });
+      task = (slowest == after.end()) ? stages_.size() : *slowest;
+    }
+    out << "Critical path:";
+    const char* separator = " ";
+    for (auto task = path.rbegin(); task != path.rend(); ++task) {
+      const Stage& stage = stages_[*task];
+      out << separator << stage.name << " (" << 1000 * (stage.end - stage.begin) << " ms)";
+      separator = " -> ";
+    }
+    out << '\n';
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+ private:
+  enum class State { kPending, kDone, kFailed, kSkipped };
+
+  struct Stage {
+    std::string name;
+    std::function<bool()> run;
+    std::vector<Task> after;
+    State state{State::kPending};  // Guarded by mutex_ while the graph runs
+    double begin{};                // Seconds since Run()
+    double end{};
+  };
+
+  [[nodiscard]] auto Seconds() const -> double {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  std::vector<Stage> stages_;
+  std::vector<std::pair<std::string, double>> marks_;  // Name, seconds since Run()
+  std::chrono::steady_clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+};
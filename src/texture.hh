@@ -1,6 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
 #include "color.hh"
+#include "hittable.hh"
+#include "texture_cache.hh"
 #include "vec3.hh"
 
 class Texture {
@@ -9,21 +16,75 @@ class Texture {
   Texture(const Texture&) = default;
   auto operator=(const Texture&) -> Texture& = default;
   Texture(Texture&&) = default;
-  auto operator=(const Texture&&) -> Texture& = default;
+  auto operator=(Texture&&) -> Texture& = default;
   virtual ~Texture() = default;
-  [[nodiscard]] virtual auto Value(double u, double v, const Point3& p) const -> Color = 0;
+  // Color at the hit point, filtered over the ray's footprint in texture space.
+  [[nodiscard]] virtual auto Value(const HitRecord& rec) const -> Color = 0;
 };
 
 class SolidColor : public Texture {
  public:
   explicit SolidColor(const Color& albedo) : albedo_(albedo) {}
   SolidColor(double red, double green, double blue) : SolidColor(Color(red, green, blue)) {}
-  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-  [[nodiscard]] auto Value([[maybe_unused]] double u, [[maybe_unused]] double v,
-                           [[maybe_unused]] const Point3& p) const -> Color override {
+  [[nodiscard]] auto Value([[maybe_unused]] const HitRecord& rec) const -> Color override {
     return albedo_;
   }
 
  private:
   Color albedo_;
 };
+
+// A tiled, mip-mapped texture file read through a TextureCache. Lookups are trilinear: bilinear
+// within the two mip levels whose texel size brackets the footprint, blended between them. The
+// texture repeats horizontally; v = 0 is the bottom row. Without mip-mapping every lookup is a
+// bilinear one in the full-resolution level.
+class ImageTexture : public Texture {
+ public:
+  ImageTexture(std::shared_ptr<TextureCache> cache, int texture, bool mip_mapped = true)
+      : cache_(std::move(cache)), texture_(texture), mip_mapped_(mip_mapped) {}
+
+  [[nodiscard]] auto Value(const HitRecord& rec) const -> Color override {
+    const auto& info = cache_->Info(texture_);
+    if (!mip_mapped_) {
+      return Bilinear(0, rec.U(), rec.V());
+    }
+    const double texels =
+        rec.UVFootprint() * static_cast<double>(std::max(info.width, info.height));
+    const double lod = std::clamp(std::log2(std::max(texels, 1e-12)), 0.0,
+                                  static_cast<double>(info.levels - 1));
+    const auto level = static_cast<uint32_t>(lod);
+    const double blend = lod - level;
+    const Color fine = Bilinear(level, rec.U(), rec.V());
+    if (blend <= 0 || level + 1 >= info.levels) {
+      return fine;
+    }
+    return ((1 - blend) * fine) + (blend * Bilinear(level + 1, rec.U(), rec.V()));
+  }
+
+ private:
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  [[nodiscard]] auto Bilinear(uint32_t level, double u, double v) const -> Color {
+    const auto& info = cache_->Info(texture_);
+    const auto width = static_cast<int64_t>(MipLevelSize(info.width, level));
+    const auto height = static_cast<int64_t>(MipLevelSize(info.height, level));
+    const double x = ((u - std::floor(u)) * static_cast<double>(width)) - 0.5;
+    const double y = ((1 - std::clamp(v, 0.0, 1.0)) * static_cast<double>(height)) - 0.5;
+    const double x_floor = std::floor(x);
+    const double y_floor = std::floor(y);
+    const double fx = x - x_floor;
+    const double fy = y - y_floor;
+    const auto x0 = static_cast<int64_t>(x_floor);
+    const auto y0 = static_cast<int64_t>(y_floor);
+    auto texel = [&](int64_t tx, int64_t ty) {
+      const auto wrapped_x = static_cast<uint32_t>(((tx % width) + width) % width);
+      const auto clamped_y = static_cast<uint32_t>(std::clamp<int64_t>(ty, 0, height - 1));
+      return cache_->Texel(texture_, level, wrapped_x, clamped_y);
+    };
+    return ((1 - fy) * (((1 - fx) * texel(x0, y0)) + (fx * texel(x0 + 1, y0)))) +
+           (fy * (((1 - fx) * texel(x0, y0 + 1)) + (fx * texel(x0 + 1, y0 + 1))));
+  }
+
+  std::shared_ptr<TextureCache> cache_;
+  int texture_;
+  bool mip_mapped_;
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "color.hh"
+#include "common.hh"
+
+// A tiled, mip-mapped texture file ("RTTX"): the header, then the tiles of every mip level (full
+// resolution first), each level in row-major tile order. A tile holds tile_size x tile_size
+// gamma-encoded RGB texels of 3 bytes; tiles on the right and bottom edges are padded by
+// repeating the last texel. Any one tile can be read without touching the rest of the file.
+struct TiledTextureHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t tile_size;
+  uint32_t levels;
+
+  static constexpr std::array<char, 4> kMagic{'R', 'T', 'T', 'X'};
+  static constexpr uint32_t kVersion = 1;
+};
+
+// Size of a mip level along one axis; each level halves the one above, rounding up.
+constexpr auto MipLevelSize(uint32_t size, uint32_t level) -> uint32_t {
+  for (; level > 0 && size > 1; level--) {
+    size = (size + 1) / 2;
+  }
+  return size;
+}
+
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+inline auto WriteTiledTexture(const std::string& path, uint32_t width, uint32_t height,
+                              const std::vector<Color>& pixels, uint32_t tile_size) -> bool {
+  // Writes linear `pixels` (row-major, top row first) with a full chain of box-filtered mip
+  // levels, filtered in linear space and stored gamma encoded like the renderer's output.
+  uint32_t levels = 1;
+  while (MipLevelSize(width, levels - 1) > 1 || MipLevelSize(height, levels - 1) > 1) {
+    levels++;
+  }
+  const TiledTextureHeader header{.magic = TiledTextureHeader::kMagic,
+                                  .version = TiledTextureHeader::kVersion,
+                                  .width = width,
+                                  .height = height,
+                                  .tile_size = tile_size,
+                                  .levels = levels};
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));  // NOLINT
+
+  std::vector<Color> level = pixels;
+  uint32_t level_width = width;
+  uint32_t level_height = height;
+  std::vector<uint8_t> tile(static_cast<size_t>(tile_size) * tile_size * 3);
+  for (uint32_t l = 0; l < levels; l++) {
+    const uint32_t tiles_x = (level_width + tile_size - 1) / tile_size;
+    const uint32_t tiles_y = (level_height + tile_size - 1) / tile_size;
+    for (uint32_t ty = 0; ty < tiles_y; ty++) {
+      for (uint32_t tx = 0; tx < tiles_x; tx++) {
+        size_t k = 0;
+        for (uint32_t y = 0; y < tile_size; y++) {
+          for (uint32_t x = 0; x < tile_size; x++) {
+            const uint32_t px = std::min((tx * tile_size) + x, level_width - 1);
+            const uint32_t py = std::min((ty * tile_size) + y, level_height - 1);
+            const Color& c = level[(static_cast<size_t>(py) * level_width) + px];
+            for (int channel = 0; channel < 3; channel++) {
+              const double encoded = std::clamp(LinerToGamma(c[channel]), 0.0, 1.0);
+              tile[k++] = static_cast<uint8_t>(std::lround(255 * encoded));
+            }
+          }
+        }
+        out.write(reinterpret_cast<const char*>(tile.data()),  // NOLINT
+                  static_cast<std::streamsize>(tile.size()));
+      }
+    }
+
+    // Box filter down to the next level. Odd sizes repeat the last row or column.
+    const uint32_t next_width = MipLevelSize(level_width, 1);
+    const uint32_t next_height = MipLevelSize(level_height, 1);
+    std::vector<Color> next(static_cast<size_t>(next_width) * next_height);
+    for (uint32_t y = 0; y < next_height; y++) {
+      for (uint32_t x = 0; x < next_width; x++) {
+        Color sum(0, 0, 0);
+        for (uint32_t dy = 0; dy < 2; dy++) {
+          for (uint32_t dx = 0; dx < 2; dx++) {
+            const uint32_t px = std::min((2 * x) + dx, level_width - 1);
+            const uint32_t py = std::min((2 * y) + dy, level_height - 1);
+            sum += level[(static_cast<size_t>(py) * level_width) + px];
+          }
+        }
+        next[(static_cast<size_t>(y) * next_width) + x] = 0.25 * sum;
+      }
+    }
+    level = std::move(next);
+    level_width = next_width;
+    level_height = next_height;
+  }
+  return static_cast<bool>(out);
+}
+
+// Loads texture tiles on demand and keeps the recently used ones under a fixed memory budget. The
+// tiles are spread over independently locked shards, each an LRU list with its share of the
+// budget, so render threads rarely wait on each other; disk reads happen outside the locks. Each
+// thread also remembers the last few tiles it used, which serves most lookups without locking.
+class TextureCache {
+ public:
+  struct TextureInfo {
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t tile_size{};
+    uint32_t levels{};
+    std::vector<uint64_t> level_offsets;  // File offset of each level's first tile
+  };
+
+  explicit TextureCache(size_t budget_bytes)
+      : shard_budget_(std::max<size_t>(budget_bytes / kShards, 1)), id_(NextId()) {}
+
+  TextureCache(const TextureCache&) = delete;
+  TextureCache(TextureCache&&) = delete;
+  auto operator=(const TextureCache&) -> TextureCache& = delete;
+  auto operator=(TextureCache&&) -> TextureCache& = delete;
+
+  ~TextureCache() {
+    for (const auto& file : files_) {
+      close(file.fd);
+    }
+  }
+
+  // Registers a texture file and returns its id, or -1 if it cannot be used.
+  auto Open(const std::string& path) -> int {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      std::cerr << "Cannot open texture " << path << ": " << std::strerror(errno) << '\n';
+      return -1;
+    }
+    TiledTextureHeader header{};
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != TiledTextureHeader::kMagic ||
+        header.version != TiledTextureHeader::kVersion || header.tile_size == 0 ||
+        header.levels == 0) {
+      std::cerr << path << " is not a tiled texture\n";
+      close(fd);
+      return -1;
+    }
+    File file{.fd = fd,
+              .info = {.width = header.width,
+                       .height = header.height,
+                       .tile_size = header.tile_size,
+                       .levels = header.levels,
+                       .level_offsets = {}}};
+    uint64_t offset = sizeof(header);
+    for (uint32_t l = 0; l < header.levels; l++) {
+      file.info.level_offsets.push_back(offset);
+      offset += TileCount(file.info, l, true) * TileCount(file.info, l, false) *
+                TileBytes(file.info);
+    }
+    const std::scoped_lock lock(files_mutex_);
+    files_.push_back(std::move(file));
+    return static_cast<int>(files_.size()) - 1;
+  }
+
+  // Must not be called concurrently with Open().
+  [[nodiscard]] auto Info(int texture) const -> const TextureInfo& { return files_[texture].info; }
+
+  // Linear color of texel (x, y) of a mip level, loading its tile if needed.
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto Texel(int texture, uint32_t level, uint32_t x, uint32_t y) -> Color {
+    const TextureInfo& info = files_[texture].info;
+    const uint32_t tile_x = x / info.tile_size;
+    const uint32_t tile_y = y / info.tile_size;
+    const uint64_t key = (static_cast<uint64_t>(texture) << 48U) |
+                         (static_cast<uint64_t>(level) << 40U) |
+                         (static_cast<uint64_t>(tile_y) << 20U) | tile_x;
+    const Tile& tile = GetTile(texture, level, key, tile_x, tile_y);
+    const size_t texel =
+        3 * ((static_cast<size_t>(y % info.tile_size) * info.tile_size) + (x % info.tile_size));
+    const auto& decode = DecodeTable();
+    return {decode[tile[texel]], decode[tile[texel + 1]], decode[tile[texel + 2]]};
+  }
+
+  auto Report(std::ostream& out) const -> void {
+    const uint64_t hits = hits_.load();
+    const uint64_t misses = misses_.load();
+    const uint64_t requests = hits + misses;
+    size_t resident = 0;
+    for (const auto& shard : shards_) {
+      const std::scoped_lock lock(shard.mutex);
+      resident += shard.bytes;
+    }
+    // Lookups served by the per-thread tables never reach the shards and are not counted.
+    constexpr double kMiB = 1024.0 * 1024.0;
+    out << "Texture cache: " << requests << " shared tile lookups, "
+        << (requests > 0 ? 100.0 * static_cast<double>(hits) / static_cast<double>(requests) : 0)
+        << "% hits, " << static_cast<double>(bytes_loaded_.load()) / kMiB << " MiB loaded, "
+        << evictions_.load() << " evictions, " << static_cast<double>(resident) / kMiB
+        << " MiB resident of " << static_cast<double>(shard_budget_ * kShards) / kMiB << " MiB\n";
+  }
+
+ private:
+  using Tile = std::vector<uint8_t>;
+
+  static constexpr size_t kShards = 32;
+  static constexpr size_t kThreadTiles = 16;  // Tiles each thread keeps without locking
+
+  struct File {
+    int fd;
+    TextureInfo info;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<std::pair<uint64_t, std::shared_ptr<const Tile>>> lru;  // Most recent first
+    std::unordered_map<uint64_t, decltype(lru)::iterator> index;
+    size_t bytes{};
+  };
+
+  struct ThreadTile {
+    uint64_t cache_id{};
+    uint64_t key{};
+    std::shared_ptr<const Tile> tile;
+  };
+
+  static auto NextId() -> uint64_t {
+    static std::atomic<uint64_t> next{1};
+    return next++;
+  }
+
+  static auto DecodeTable() -> const std::array<double, 256>& {
+    static const auto kTable = [] {
+      std::array<double, 256> table{};
+      for (size_t k = 0; k < table.size(); k++) {
+        const double encoded = static_cast<double>(k) / 255;
+        table[k] = encoded * encoded;  // Inverse of LinerToGamma
+      }
+      return table;
+    }();
+    return kTable;
+  }
+
+  static auto TileCount(const TextureInfo& info, uint32_t level, bool horizontal) -> uint64_t {
+    const uint32_t size = MipLevelSize(horizontal ? info.width : info.height, level);
+    return (size + info.tile_size - 1) / info.tile_size;
+  }
+
+  static auto TileBytes(const TextureInfo& info) -> uint64_t {
+    return static_cast<uint64_t>(info.tile_size) * info.tile_size * 3;
+  }
+
+  // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+  auto GetTile(int texture, uint32_t level, uint64_t key, uint32_t tile_x, uint32_t tile_y)
+      -> const Tile& {
+    // Holding a reference in the thread's own table keeps a tile alive while it is read, even if
+    // its shard evicts it meanwhile.
+    thread_local std::array<ThreadTile, kThreadTiles> thread_tiles;
+    ThreadTile& slot = thread_tiles[MixBits(key) % kThreadTiles];
+    if (slot.cache_id == id_ && slot.key == key) {
+      return *slot.tile;
+    }
+
+    Shard& shard = shards_[MixBits(key ^ id_) % kShards];
+    {
+      const std::scoped_lock lock(shard.mutex);
+      if (const auto found = shard.index.find(key); found != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        slot = {.cache_id = id_, .key = key, .tile = found->second->second};
+        return *slot.tile;
+      }
+    }
+
+    const File& file = files_[texture];
+    const uint64_t bytes = TileBytes(file.info);
+    auto tile = std::make_shared<Tile>(bytes);
+    const uint64_t offset = file.info.level_offsets[level] +
+                            (((tile_y * TileCount(file.info, level, true)) + tile_x) * bytes);
+    if (pread(file.fd, tile->data(), bytes, static_cast<off_t>(offset)) !=
+        static_cast<ssize_t>(bytes)) {
+      if (!read_error_.exchange(true)) {
+        std::cerr << "Failed to read texture tile: " << std::strerror(errno) << '\n';
+      }
+      std::fill(tile->begin(), tile->end(), 0);
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    bytes_loaded_.fetch_add(bytes, std::memory_order_relaxed);
+
+    std::shared_ptr<const Tile> result = std::move(tile);
+    {
+      const std::scoped_lock lock(shard.mutex);
+      if (const auto found = shard.index.find(key); found != shard.index.end()) {
+        result = found->second->second;  // Another thread loaded it first
+      } else {
+        shard.lru.emplace_front(key, result);
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += bytes;
+        while (shard.bytes > shard_budget_ && shard.lru.size() > 1) {
+          shard.bytes -= shard.lru.back().second->size();
+          shard.index.erase(shard.lru.back().first);
+          shard.lru.pop_back();
+          evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+    slot = {.cache_id = id_, .key = key, .tile = std::move(result)};
+    return *slot.tile;
+  }
+
+  size_t shard_budget_;
+  uint64_t id_;  // Tells this cache's tiles apart in the per-thread tables
+  std::mutex files_mutex_;
+  std::deque<File> files_;
+  std::array<Shard, kShards> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> bytes_loaded_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<bool> read_error_{false};
+};
@@ -98,33 +98,6 @@ inline auto Cross(const Vec3& u, const Vec3& v) -> Vec3 {
 
 inline auto UnitVector(const Vec3& v) -> Vec3 { return v / v.Length(); }
 
-inline auto RandomInUnitDisk() -> Vec3 {
-  while (true) {
-    const auto p{Vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 0)};
-    if (p.LengthSquared() < 1) {
-      return p;
-    }
-  }
-}
-
-inline auto RandomUnitVector() -> Vec3 {
-  while (true) {
-    const Vec3 p = Vec3::Random(-1, 1);
-    const double len_sq = p.LengthSquared();
-    if (1e-160 < len_sq && len_sq <= 1) {
-      return p / sqrt(len_sq);
-    }
-  }
-}
-
-inline auto RandomOnHemisphere(const Vec3& normal) -> Vec3 {
-  Vec3 on_unit_hemisphere = RandomUnitVector();
-  if (Dot(on_unit_hemisphere, normal) > 0.0) {  // In the same hemisphere as the normal
-    return on_unit_hemisphere;
-  }
-  return -on_unit_hemisphere;
-}
-
 inline auto Reflect(const Vec3& v, const Vec3& n) -> Vec3 { return v - 2 * Dot(v, n) * n; }
 
 inline auto Refract(const Vec3& uv, const Vec3& n, double eta_i_over_eta_t) -> Vec3 {